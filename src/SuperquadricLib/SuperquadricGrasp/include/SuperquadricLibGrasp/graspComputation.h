@@ -24,6 +24,7 @@
 #define GRASPCOMPUTATION_H
 
 #include <SuperquadricLibModel/superquadricEstimator.h>
+#include <SuperquadricLibModel/superqSolver.h>
 #include <SuperquadricLibGrasp/graspPoses.h>
 
 namespace SuperqGrasp {
@@ -86,6 +87,11 @@ protected:
     /* Vector containing robot pose */
     Vector6d robot_pose;
 
+    /* Points sampled on the hand, stored as arrays for the cost evaluation */
+    SuperqModel::PointsSoA points_on_soa;
+    /* Points sampled on the hand in the current pose */
+    SuperqModel::PointsSoA points_on_tr;
+
 public:
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -214,6 +220,9 @@ struct GraspResults
 };
 class GraspEstimatorApp : public Options
 {
+     /* Ipopt session, reused for all the grasp computations until an option changes */
+     SuperqModel::IpoptSession session;
+
 public:
      GraspEstimatorApp();
      /*****************************************************************/
@@ -226,6 +235,8 @@ public:
      bool setVector(const std::string &tag, const Eigen::VectorXd &value);
      /*****************************************************************/
      bool setMatrix(const std::string &tag, const Eigen::MatrixXd &value);
+     /*****************************************************************/
+     double getSetupTimeSaved() const;
 
 };
 
@@ -108,6 +108,8 @@ void graspComputation::init(GraspParams &g_params)
         }
     }
 
+    points_on_soa.setPoints(points_on);
+
     // Configure cone parameters for orientation constraints
     if (l_o_r == "right")
     {
@@ -262,16 +264,13 @@ bool graspComputation::eval_f(Ipopt::Index n, const Ipopt::Number *x, bool new_x
 /****************************************************************/
 double graspComputation::F(const Ipopt::Number *x, deque<Vector3d> &points_on, bool new_x)
 {
-     double value = 0.0;
-
-     for(auto point : points_on)
-     {
-         value += pow( pow(f(x,point),object(3))-1,2 );
-     }
+     Vector6d x_tmp;
+     for (int i = 0; i < 6; i++)
+        x_tmp(i) = x[i];
 
-     value *= object(0)*object(1)*object(2)/points_on.size();
+     aux_objvalue = F_v(x_tmp);
 
-     aux_objvalue = value;
+     return aux_objvalue;
 }
 
 /****************************************************************/
@@ -316,15 +315,12 @@ double graspComputation::f(const Ipopt::Number *x, Vector3d &point)
 /****************************************************************/
 double graspComputation::F_v(const Vector6d &x)
 {
-     // Compute cost function for finite difference gradient
-     double value = 0.0;
-
-     for(auto point : points_on)
-        value += pow( pow(f_v(x,point),object(3))-1,2 );
+     // Move all the hand points in the pose x and evaluate the object
+     // inside-outside function on them at once
+     Matrix4d H_x = computeMatrix(x);
+     points_on_soa.transform(H_x.block<3,3>(0,0), H_x.col(3).head<3>(), points_on_tr);
 
-     value *= object(0)*object(1)*object(2)/points_on.size();
-
-     return value;
+     return SuperqKernel::cost(object, points_on_tr);
 }
 
 /****************************************************************/
@@ -634,14 +630,7 @@ void graspComputation::finalize_solution(Ipopt::SolverReturn status, Ipopt::Inde
     }
 
     // Compute final distance between object
-    final_F_value = 0.0;
-
-    for(auto point : points_on)
-    {
-      final_F_value += pow( pow(f_v(solution_vector,point),object(3))-1,2 );
-    }
-
-    final_F_value /= points_on.size();
+    final_F_value = F_v(solution_vector)/(object(0)*object(1)*object(2));
 
     cout << "final F value " << final_F_value << endl;
 
@@ -889,7 +878,7 @@ double graspComputation::f_v2(const Vector11d &obj, const Vector3d &point_tr)
     return pow( abs(tmp),obj(4)/obj(3)) + pow( abs(num3/obj(2)),(2.0/obj(3)));
 }
 
-GraspEstimatorApp::GraspEstimatorApp()
+GraspEstimatorApp::GraspEstimatorApp() : session(true)
 {
     pars.tol = 1e-5;
     pars.constr_tol = 1e-4;
@@ -925,18 +914,8 @@ GraspEstimatorApp::GraspEstimatorApp()
 /*****************************************************************/
 GraspResults GraspEstimatorApp::computeGraspPoses(vector<Superquadric> &object_superqs)
 {
-    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = new Ipopt::IpoptApplication;
-    app->Options()->SetNumericValue("tol",pars.tol);
-    app->Options()->SetNumericValue("constr_viol_tol",pars.constr_tol);
-    app->Options()->SetIntegerValue("acceptable_iter",pars.acceptable_iter);
-    app->Options()->SetStringValue("mu_strategy",pars.mu_strategy);
-    app->Options()->SetIntegerValue("max_iter",pars.max_iter);
-    app->Options()->SetNumericValue("max_cpu_time",pars.max_cpu_time);
-    app->Options()->SetStringValue("nlp_scaling_method",pars.nlp_scaling_method);
-    app->Options()->SetStringValue("hessian_approximation",pars.hessian_approximation);
-    app->Options()->SetIntegerValue("print_level",pars.print_level);
-    //app->Options()->SetStringValue("derivative_test","first-order");
-    //app->Options()->SetStringValue("derivative_test_print_all","yes");
+    // The application is initialized once and reused for all the objects
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = session.get(pars);
 
     GraspResults results;
 
@@ -944,8 +923,6 @@ GraspResults GraspEstimatorApp::computeGraspPoses(vector<Superquadric> &object_s
     {
         for (size_t i = 0; i < object_superqs.size(); i++)
         {
-            app->Initialize();
-
             g_params.object_superq = object_superqs[i];
 
             g_params.obstacle_superqs.clear();
@@ -962,7 +939,11 @@ GraspResults GraspEstimatorApp::computeGraspPoses(vector<Superquadric> &object_s
 
             clock_t tStart = clock();
 
-            Ipopt::ApplicationReturnStatus status = app->OptimizeTNLP(GetRawPtr(estim));
+            Ipopt::ApplicationReturnStatus status;
+            {
+                lock_guard<mutex> lock(IpoptSession::optimizationMutex());
+                status = app->OptimizeTNLP(GetRawPtr(estim));
+            }
 
             double computation_time = (double)(clock() - tStart)/CLOCKS_PER_SEC;
 
@@ -1108,6 +1089,12 @@ void GraspEstimatorApp::refinePoseCost(GraspResults &grasp_res)
 
 }
 
+/*****************************************************************/
+double GraspEstimatorApp::getSetupTimeSaved() const
+{
+    return session.getSetupTimeSaved();
+}
+
 /*****************************************************************/
 double GraspEstimatorApp::getPlaneHeight()
 {
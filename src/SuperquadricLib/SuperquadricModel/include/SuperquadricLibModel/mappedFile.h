@@ -0,0 +1,98 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+
+ /**
+  * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+  */
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace SuperqModel {
+
+/**
+* \class SuperqModel::MappedFile
+* \headerfile mappedFile.h <SuperquadricModel/include/mappedFile.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class gives read-only access to the content of a file. On POSIX systems the
+* file is memory-mapped, so that the pages are loaded by the kernel only when they
+* are read, elsewhere it is read at once in a buffer. The content stays valid until
+* the object is closed or destroyed.
+*/
+class MappedFile
+{
+    const char *data;
+    size_t length;
+    bool mapped;
+    // Content of the file when it is not mapped
+    std::vector<char> buffer;
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+public:
+
+    /**
+    * Constructor of a closed file
+    */
+    MappedFile();
+
+    /**
+    * Destructor, unmaps the file
+    */
+    ~MappedFile();
+
+    /** Open a file
+    * @param file_name is the name of the file
+    * @return false if the file cannot be opened or read
+    */
+    /*********************************************/
+    bool open(const std::string &file_name);
+
+    /** Release the content of the file */
+    /*********************************************/
+    void close();
+
+    /** Get the content of the file
+    * @return a pointer to the first byte, nullptr if the file is closed or empty
+    */
+    /*********************************************/
+    const char *begin() const;
+
+    /** Get the end of the content of the file
+    * @return a pointer past the last byte
+    */
+    /*********************************************/
+    const char *end() const;
+
+    /** Get the size of the file
+    * @return the number of bytes
+    */
+    /*********************************************/
+    size_t size() const;
+};
+
+}
+
+#endif
@@ -38,13 +38,28 @@ struct IpoptParam
     int acceptable_iter;
     std::string mu_strategy;
     int max_iter;
+    /* Time limit of each optimization [s]: Ipopt cpu time, or wall time from its start for
+     levenberg-marquardt and for the Ipopt optimizations of the concurrent estimations */
     double max_cpu_time;
     std::string nlp_scaling_method;
     std::string hessian_approximation;
+    std::string derivative_test;
     int print_level;
     std::string object_class;
     int optimizer_points;
     bool random_sampling;
+    /* Downsampling method (stride, random, reservoir, voxel, farthest or curvature), random_sampling selects stride or random */
+    std::string sampling_method;
+    std::string solver;
+    double tracking_threshold;
+    bool warm_start;
+    /* Object classes compared by computeSuperqAutoClass */
+    std::vector<std::string> object_classes;
+    /* Normalized residual below which a class wins over the classes listed after it in object_classes */
+    double class_win_residual;
+    /* Threads for concurrent estimations, 0 for all the hardware threads.
+     The Ipopt optimizations are serialized (MUMPS is not reentrant), only levenberg-marquardt runs concurrently */
+    int n_threads;
 };
 
 struct MultipleParams
@@ -56,6 +71,15 @@ struct MultipleParams
     double threshold_section2;
     double threshold_axis;
     double debug;
+    /* Fit sibling subtrees and merge re-fits concurrently, on n_threads threads */
+    bool parallel_modeling;
+    /* Split a node only if its superquadric does not fit its points, fraction_pc bounds the depth */
+    bool adaptive_splitting;
+    /* Normalized residual above which a node is split by adaptive_splitting */
+    double split_residual;
+    /* Start the fits of two children from the superquadric of their father, cut by the splitting plane.
+     Off by default: on the shipped examples it does not reduce the iterations of levenberg-marquardt */
+    bool parent_initial_guess;
 };
 
 struct GraspParams
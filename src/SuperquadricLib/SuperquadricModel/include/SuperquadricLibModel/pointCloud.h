@@ -26,13 +26,284 @@
 #include <Eigen/Dense>
 #include <Eigen/StdVector>
 #include <Eigen/SVD>
+#include <cstring>
 #include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
 typedef Eigen::Matrix<double, 3, 2>  Matrix32d;
 
 namespace SuperqModel {
 
+class KdTree;
+class MappedFile;
+class VoxelHash;
+
+/**
+* \class SuperqModel::PointStore
+* \headerfile pointcloud.h <SuperquadricModel/include/pointcloud.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class holds the points of a cloud, either copied in its own vector or as a
+* read-only view of a buffer owned by the caller, with float or double coordinates
+* and any stride between consecutive points (e.g. the x, y, z fields of a XYZRGBA
+* sensor frame). It is never modified after construction, so it can be shared by
+* the copies of a point cloud.
+*/
+class PointStore
+{
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> owned;
+    const unsigned char *data;
+    size_t stride;
+    bool single_precision;
+    int n;
+    // Keeps alive the owner of the viewed buffer, if any
+    std::shared_ptr<const void> owner;
+
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    /**
+    * Constructor of an empty store
+    */
+    PointStore();
+
+    /**
+     * Constructor copying the points
+     * @param p is a deque of 3d eigen vectors
+     */
+    PointStore(const std::deque<Eigen::Vector3d> &p);
+
+    /**
+     * Constructor taking the points
+     * @param p is a vector of 3d eigen vectors, moved into the store
+     */
+    PointStore(std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> &&p);
+
+    /**
+     * Constructor of a view, the buffer has to outlive the store
+     * @param buffer points to the x coordinate of the first point, followed by y and z
+     * @param num is the number of points
+     * @param stride_bytes is the distance in bytes between two consecutive points
+     * @param buffer_owner is kept alive as long as the store, e.g. the mapped file containing the buffer
+     */
+    PointStore(const double *buffer, const int &num, const size_t &stride_bytes,
+               const std::shared_ptr<const void> &buffer_owner = std::shared_ptr<const void>());
+
+    /**
+     * Constructor of a view, the buffer has to outlive the store
+     * @param buffer points to the x coordinate of the first point, followed by y and z
+     * @param num is the number of points
+     * @param stride_bytes is the distance in bytes between two consecutive points
+     * @param buffer_owner is kept alive as long as the store, e.g. the mapped file containing the buffer
+     */
+    PointStore(const float *buffer, const int &num, const size_t &stride_bytes,
+               const std::shared_ptr<const void> &buffer_owner = std::shared_ptr<const void>());
+
+    /**
+     * Get the number of points
+     * @return the number of points
+     */
+    int size() const;
+
+    /**
+     * Check if the points are owned by the caller
+     * @return true if the store is a view
+     */
+    bool isView() const;
+
+    /**
+     * Get a point
+     * @param i is the point index
+     * @return the point
+     */
+    inline Eigen::Vector3d point(const int &i) const
+    {
+        if (data == nullptr)
+            return owned[i];
+
+        const unsigned char *p = data + i*stride;
+        if (single_precision)
+        {
+            float xyz[3];
+            std::memcpy(xyz, p, sizeof(xyz));
+            return Eigen::Vector3d(xyz[0], xyz[1], xyz[2]);
+        }
+        else
+        {
+            double xyz[3];
+            std::memcpy(xyz, p, sizeof(xyz));
+            return Eigen::Vector3d(xyz[0], xyz[1], xyz[2]);
+        }
+    }
+};
+
+/**
+* \class SuperqModel::PointColors
+* \headerfile pointcloud.h <SuperquadricModel/include/pointcloud.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class holds the rgb colors of the points packed in a single array, three bytes
+* per point, either owned or as a view of a buffer kept alive by its owner (e.g. a
+* mapped file). It is not modified after construction, so copies share the array.
+* colors[i] gives the three channels of the i-th point.
+*/
+class PointColors
+{
+    std::shared_ptr<const void> owner;
+    const unsigned char *rgb;
+    int n;
+
+public:
+
+    /**
+    * Constructor of empty colors
+    */
+    PointColors();
+
+    /**
+     * Constructor taking the colors
+     * @param packed are the rgb channels of the points, moved into the colors
+     */
+    PointColors(std::vector<unsigned char> &&packed);
+
+    /**
+     * Constructor of a view
+     * @param buffer contains the rgb channels of the points
+     * @param num is the number of points
+     * @param buffer_owner is kept alive as long as the colors
+     */
+    PointColors(const unsigned char *buffer, const int &num, const std::shared_ptr<const void> &buffer_owner);
+
+    /**
+     * Get the number of colors
+     * @return the number of points with a color
+     */
+    int size() const;
+
+    /**
+     * Check if there are no colors
+     * @return true if empty
+     */
+    bool empty() const;
+
+    /**
+     * Remove the colors
+     */
+    void clear();
+
+    /**
+     * Get the packed rgb channels
+     * @return a pointer to the 3*size() channels, nullptr if empty
+     */
+    const unsigned char *data() const;
+
+    /**
+     * Get the owner of the packed channels, to keep them alive without copying them
+     * @return the owner
+     */
+    const std::shared_ptr<const void> &getOwner() const;
+
+    /**
+     * Get the color of a point
+     * @param i is the point index
+     * @return a pointer to the r, g and b channels
+     */
+    inline const unsigned char *operator[](const int &i) const
+    {
+        return rgb + 3*i;
+    }
+};
+
+/**
+* \class SuperqModel::PointCloudStats
+* \headerfile pointcloud.h <SuperquadricModel/include/pointcloud.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class accumulates in a single pass the statistics of a set of points used
+* by the estimation: number of points, sum, second moments and axis-aligned bounds.
+* Two accumulators can be merged, e.g. the ones of the two sides of a splitting plane
+* give the statistics of the whole point cloud.
+*/
+class PointCloudStats
+{
+public:
+
+    int count;
+    Eigen::Vector3d sum;
+    // Sum of p*p^T, only the upper triangle is accumulated
+    Eigen::Matrix3d moments;
+    Eigen::Vector3d lower;
+    Eigen::Vector3d upper;
+
+    /**
+    * Constructor of empty statistics
+    */
+    PointCloudStats();
+
+    /**
+     * Add a point
+     * @param p is the point
+     */
+    inline void add(const Eigen::Vector3d &p)
+    {
+        count++;
+        sum += p;
+
+        moments(0,0) += p(0)*p(0);
+        moments(0,1) += p(0)*p(1);
+        moments(0,2) += p(0)*p(2);
+        moments(1,1) += p(1)*p(1);
+        moments(1,2) += p(1)*p(2);
+        moments(2,2) += p(2)*p(2);
+
+        lower = lower.cwiseMin(p);
+        upper = upper.cwiseMax(p);
+    }
+
+    /**
+     * Add the points of other statistics
+     * @param other are the statistics to be merged
+     */
+    void merge(const PointCloudStats &other);
+
+    /**
+     * get the mean of the points
+     * @return the mean
+     */
+    Eigen::Vector3d getMean() const;
+
+    /**
+     * get the bounding box of the points
+     * @return a 3x2 matrix with the minimum and maximum coordinates
+     */
+    Matrix32d getBoundingBox() const;
+
+    /**
+     * get the center of the bounding box of the points
+     * @return the center
+     */
+    Eigen::Vector3d getCenter() const;
+
+    /**
+     * get the second moments of the points with respect to a point, divided by their number
+     * @param center is the point
+     * @return the symmetric 3x3 matrix of the moments
+     */
+    Eigen::Matrix3d getCovariance(const Eigen::Vector3d &center) const;
+
+    /**
+     * get the principal axes of the points, computed with respect to the center of the bounding box
+     * @return a 3x3 matrix containing the axes
+     */
+    Eigen::Matrix3d getAxes() const;
+};
+
 /**
 * \class SuperqModel::3Dpoints
 * \headerfile pointcloud.h <SuperquadricModel/include/pointcloud.h>
@@ -40,15 +311,77 @@ namespace SuperqModel {
 * \brief A class from SuperqModel namespace.
 *
 * This class contains a 3D point cloud used for estimating the superquadric.
+* The points are kept once in a shared PointStore, a point cloud is a view of them:
+* the points "for vis" are all the points of the store or a subset of them (e.g. one
+* side of a splitting plane), while the points used for the estimation are the ones
+* for vis or, after subSample, a subset of them. Views are indices, so copying a
+* point cloud, splitting it or downsampling it does not copy the points. The views
+* made by splitByPlane are contiguous ranges of a new array of indices. Only the
+* multiple superquadric estimation partitions them in place when they are split in
+* turn, as it is the only user of the views of its tree.
 */
 class PointCloud
 {
+    std::shared_ptr<const PointStore> store;
+    // Indices in the store of the points for vis, null for all the points,
+    // the points are the range of vis_count indices from vis_offset
+    std::shared_ptr<std::vector<int>> vis_indices;
+    int vis_offset;
+    int vis_count;
+    // True if the range of vis_indices is owned by this view and its copies, as made by splitByPlane
+    bool vis_range_owned;
+    // Indices among the points for vis of the downsampled points, null if not downsampled
+    std::shared_ptr<const std::vector<int>> sample_indices;
+    // Statistics of the points for vis, null if not known yet
+    std::shared_ptr<const PointCloudStats> vis_stats;
+
+    // Spatial indices of the points for vis, built on demand and shared by the copies
+    struct SpatialCache
+    {
+        std::mutex mutex;
+        std::shared_ptr<const KdTree> kd_tree;
+        std::shared_ptr<const VoxelHash> voxel_hash;
+        double voxel_cell_size;
+    };
+    std::shared_ptr<SpatialCache> spatial_cache;
+
+    /**
+     * get the index in the store of a point for vis
+     * @param i is the point index, in [0, getNumberPointsForVis())
+     * @return the index in the store
+     */
+    inline int storeIndex(const int &i) const
+    {
+        return (vis_indices ? (*vis_indices)[vis_offset + i] : i);
+    }
+
+    /**
+     * set the points as a view of a binary file written by writeToBinaryFile
+     * @param file is the mapped file, kept open as long as the points are used
+     * @return true if the file is valid and has at least one point
+     */
+    bool setPointsFromBinary(const std::shared_ptr<const MappedFile> &file);
+
+    /**
+     * split the points for visualization by a plane, as the public splitByPlane.
+     * If in_place is true and this is a view made by splitByPlane, its range of the
+     * array of indices is partitioned, so that a tree of splits uses a single array.
+     * The other views of the range then see the same points in a different order,
+     * and the spatial indices of the views containing the range become out of date:
+     * the caller must own all of them, as SuperqEstimatorApp does with its tree
+     * @param plane contains the normal n and the offset d of the plane
+     * @param above is filled with the points p such that n.dot(p) > d
+     * @param below is filled with the other points
+     * @param in_place is true for partitioning the range of this view
+     */
+    void splitByPlane(const Eigen::Vector4d &plane, PointCloud &above, PointCloud &below, const bool &in_place);
+
+    friend class SuperqEstimatorApp;
+
 public:
 
     int n_points;
-    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> points;
-    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> points_for_vis;
-    std::vector<std::vector<unsigned char>> colors;
+    PointColors colors;
     Eigen::Vector3d barycenter;
     Eigen::Matrix3d orientation;
     Matrix32d bounding_box;
@@ -72,6 +405,43 @@ public:
      */
     bool setPoints(const std::deque<Eigen::Vector3d> &p);
 
+    /**
+     * set points of the point cloud as a view of a buffer owned by the caller, without copying them.
+     * The buffer has to stay valid and unchanged as long as the point cloud, or its copies, are used
+     * @param buffer points to the x coordinate of the first point, followed by y and z
+     * @param num is the number of points
+     * @param stride_bytes is the distance in bytes between two consecutive points
+     * @return true is number of points > 0
+     */
+    bool setPoints(const double *buffer, const int &num, const size_t &stride_bytes = 3*sizeof(double));
+
+    /**
+     * set points of the point cloud as a view of a buffer owned by the caller, without copying them.
+     * The buffer has to stay valid and unchanged as long as the point cloud, or its copies, are used
+     * @param buffer points to the x coordinate of the first point, followed by y and z
+     * @param num is the number of points
+     * @param stride_bytes is the distance in bytes between two consecutive points
+     * @return true is number of points > 0
+     */
+    bool setPoints(const float *buffer, const int &num, const size_t &stride_bytes = 3*sizeof(float));
+
+    /**
+     * set points of the point cloud as a subset of the points of another one, without copying them
+     * @param source is the point cloud whose points for vis are selected
+     * @param indices are the indices of the selected points, in [0, source.getNumberPointsForVis())
+     * @return true is number of points > 0
+     */
+    bool setPoints(const PointCloud &source, const std::vector<int> &indices);
+
+    /**
+     * set points of the point cloud as a subset of the points of another one, without copying them
+     * @param source is the point cloud whose points for vis are selected
+     * @param indices are the indices of the selected points, in [0, source.getNumberPointsForVis())
+     * @param stats are the statistics of the selected points, e.g. accumulated while selecting them
+     * @return true is number of points > 0
+     */
+    bool setPoints(const PointCloud &source, const std::vector<int> &indices, const PointCloudStats &stats);
+
     /**
      * set colors of the point cloud
      * @param c is a vector of vector of char
@@ -80,17 +450,102 @@ public:
     /*********************************************/
     bool setColors(const std::vector<std::vector<unsigned char>> &c);
 
+    /**
+     * set colors of the point cloud
+     * @param rgb are the packed rgb channels of the points, moved into the point cloud
+     * @return true the number of colors is equal to the number of points
+     */
+    /*********************************************/
+    bool setColors(std::vector<unsigned char> &&rgb);
+
     /**
      * get the number of points of the point cloud
      * @return the number of points
      */
-    int getNumberPoints();
+    int getNumberPoints() const;
+
+    /**
+     * get a point of the point cloud
+     * @param i is the point index, in [0, getNumberPoints())
+     * @return the point
+     */
+    inline Eigen::Vector3d getPoint(const int &i) const
+    {
+        return store->point(storeIndex(sample_indices ? (*sample_indices)[i] : i));
+    }
+
+    /**
+     * get the points of the point cloud
+     * @return a copy of the points
+     */
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> getPoints() const;
+
+    /**
+     * get the number of points for visualization, i.e. before downsampling
+     * @return the number of points
+     */
+    int getNumberPointsForVis() const;
+
+    /**
+     * get a point for visualization
+     * @param i is the point index, in [0, getNumberPointsForVis())
+     * @return the point
+     */
+    inline Eigen::Vector3d getPointForVis(const int &i) const
+    {
+        return store->point(storeIndex(i));
+    }
+
+    /**
+     * get the points for visualization
+     * @return a copy of the points
+     */
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> getPointsForVis() const;
 
     /**
      * delete the points of the point cloud
      */
     void deletePoints();
 
+    /**
+     * get the statistics of the points used for the estimation, in a single pass
+     * or none if they are the points for vis and their statistics are known
+     * @return the statistics
+     */
+    PointCloudStats getStats() const;
+
+    /**
+     * get the statistics of the points for visualization, i.e. before downsampling
+     * @return the statistics
+     */
+    PointCloudStats getStatsForVis() const;
+
+    /**
+     * split the points for visualization by a plane, in two views of this point cloud.
+     * The views share a new array of indices, this point cloud and its copies are not
+     * modified. The relative order of the points on each side is preserved
+     * @param plane contains the normal n and the offset d of the plane
+     * @param above is filled with the points p such that n.dot(p) > d
+     * @param below is filled with the other points
+     */
+    void splitByPlane(const Eigen::Vector4d &plane, PointCloud &above, PointCloud &below);
+
+    /**
+     * get a KD-tree of the points for visualization, built at the first call and
+     * kept until the points change
+     * @param n_threads is the number of threads building the tree, 0 for the number of hardware threads
+     * @return the tree, its indices are the ones of the points for vis
+     */
+    std::shared_ptr<const KdTree> getKdTree(const int &n_threads = 0) const;
+
+    /**
+     * get a voxel hash of the points for visualization, built at the first call and
+     * kept until the points or the cell size change
+     * @param cell_size is the size of the cells
+     * @return the voxel hash, its indices are the ones of the points for vis
+     */
+    std::shared_ptr<const VoxelHash> getVoxelHash(const double &cell_size) const;
+
     /**
      * get the bounding box of the point cloud
      * @return a 3d matrix containing the bounding box of the point cloud
@@ -120,14 +575,44 @@ public:
 
 
     /**
-     * Subsample the point cloud
+     * Subsample the point cloud, the points for vis are not changed
      * @param desired_points_num is the desired number of points after the downsampling
+     * @param random selects random points instead of equally spaced ones
      */
     void subSample(const int &desired_points_num, const bool &random);
 
-    bool readFromFile(const char* file_name);
+    /**
+     * Subsample the point cloud, the points for vis are not changed
+     * @param desired_points_num is the desired number of points after the downsampling
+     * @param method is the sampling method (stride, random, reservoir, voxel, farthest or curvature), see PointSampler
+     * @return false if the method is unknown
+     */
+    bool subSample(const int &desired_points_num, const std::string &method);
+
+    /**
+     * read the points from a file. Binary files written by writeToBinaryFile are memory-mapped and
+     * their points are used without copying them. Text files have one point per line with its
+     * coordinates followed by the optional rgb color, reading stops at the first line without three coordinates
+     * @param file_name is the name of the file
+     * @param n_threads is the number of threads parsing large files, 0 for the number of hardware threads
+     * @return true if at least one point has been read
+     */
+    bool readFromFile(const char* file_name, const int &n_threads = 0);
 
-    bool readFromFile(const std::string &file_name);
+    /**
+     * read the points from a text file, see readFromFile(const char*, const int&)
+     */
+    bool readFromFile(const std::string &file_name, const int &n_threads = 0);
+
+    /**
+     * write the points for vis and their colors, if any, to a binary file that readFromFile loads without parsing.
+     * The file starts with a header (number of points, stride, float or double coordinates, presence of colors)
+     * followed by the packed xyz coordinates and the packed rgb colors, in the byte order of the machine
+     * @param file_name is the name of the file
+     * @param single_precision stores the coordinates as float instead of double
+     * @return true if the file has been written
+     */
+    bool writeToBinaryFile(const std::string &file_name, const bool &single_precision = false) const;
 
 };
 
@@ -0,0 +1,141 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+
+ /**
+  * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+  */
+
+#ifndef POINTFILTER_H
+#define POINTFILTER_H
+
+#include <vector>
+
+namespace SuperqModel {
+
+class PointCloud;
+
+/**
+* \class SuperqModel::PointFilter
+* \headerfile pointFilter.h <SuperquadricModel/include/pointFilter.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class is the interface of the methods used for removing the outliers of a
+* point cloud. A filter selects the indices of the points to be kept, the point
+* cloud is then reduced to a view of them, with their colors.
+*/
+class PointFilter
+{
+protected:
+    int n_threads;
+
+public:
+
+    /** Constructor
+    * @param threads is the number of threads, 0 for the number of hardware threads
+    */
+    PointFilter(const int &threads = 0);
+
+    virtual ~PointFilter();
+
+    /** Select the points to be kept
+    * @param point_cloud is the point cloud, its points for vis are filtered
+    * @param indices is filled with the increasing indices of the selected points
+    */
+    /****************************************************************/
+    virtual void select(const PointCloud &point_cloud, std::vector<int> &indices) const = 0;
+
+    /** Remove the outliers of a point cloud, without copying its points
+    * @param point_cloud is the point cloud, reduced to the selected points, unchanged if none is selected
+    * @return the number of removed points
+    */
+    /****************************************************************/
+    int filter(PointCloud &point_cloud) const;
+};
+
+/**
+* \class SuperqModel::DBSCANFilter
+* \headerfile pointFilter.h <SuperquadricModel/include/pointFilter.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class clusters the points with DBSCAN and keeps the largest cluster. The
+* points are grouped in a VoxelHash whose cells have diagonal equal to the radius:
+* the points of a cell are neighbors of each other, so a cell with enough points is
+* made of core points of the same cluster, and two cells are merged as soon as one
+* pair of their core points is close enough. The cells are merged with a lock-free
+* union-find, so that the clusters do not depend on the number of threads.
+*/
+class DBSCANFilter : public PointFilter
+{
+    double radius;
+    int min_points;
+
+public:
+
+    /** Constructor
+    * @param r is the radius of the neighborhoods
+    * @param m is the minimum number of points in the neighborhood of a core point, itself included
+    * @param threads is the number of threads, 0 for the number of hardware threads
+    */
+    DBSCANFilter(const double &r = 0.01, const int &m = 10, const int &threads = 0);
+
+    /** Cluster the points
+    * @param point_cloud is the point cloud, its points for vis are clustered
+    * @param labels is filled with the cluster of each point, -1 for noise, clusters
+    *        numbered in order of their first point
+    * @return the number of clusters
+    */
+    /****************************************************************/
+    int cluster(const PointCloud &point_cloud, std::vector<int> &labels) const;
+
+    /****************************************************************/
+    void select(const PointCloud &point_cloud, std::vector<int> &indices) const override;
+};
+
+/**
+* \class SuperqModel::RadiusOutlierFilter
+* \headerfile pointFilter.h <SuperquadricModel/include/pointFilter.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class counts the neighbors of each point within a radius and removes the
+* points having fewer neighbors than the mean minus a multiple of the standard
+* deviation, e.g. isolated points and sparse noise around the object.
+*/
+class RadiusOutlierFilter : public PointFilter
+{
+    double radius;
+    double std_ratio;
+
+public:
+
+    /** Constructor
+    * @param r is the radius of the neighborhoods
+    * @param s is the number of standard deviations below the mean count of neighbors
+    * @param threads is the number of threads, 0 for the number of hardware threads
+    */
+    RadiusOutlierFilter(const double &r = 0.01, const double &s = 1.0, const int &threads = 0);
+
+    /****************************************************************/
+    void select(const PointCloud &point_cloud, std::vector<int> &indices) const override;
+};
+
+}
+
+#endif
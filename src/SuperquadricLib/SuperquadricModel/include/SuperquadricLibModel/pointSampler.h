@@ -0,0 +1,221 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+
+ /**
+  * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+  */
+
+#ifndef POINTSAMPLER_H
+#define POINTSAMPLER_H
+
+#include <Eigen/Dense>
+#include <string>
+#include <vector>
+
+namespace SuperqModel {
+
+class PointCloud;
+
+/**
+* \class SuperqModel::PointSampler
+* \headerfile pointSampler.h <SuperquadricModel/include/pointSampler.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class is the interface of the methods used for downsampling a point cloud.
+* A sampler selects the indices of the points, it does not copy them. The random
+* samplers use their own generator, seeded at every call, so that they give always
+* the same points and can be used by many threads at once.
+*/
+class PointSampler
+{
+protected:
+    unsigned int seed;
+
+public:
+
+    /** Constructor
+    * @param s is the seed of the random generator
+    */
+    PointSampler(const unsigned int &s = 1);
+
+    virtual ~PointSampler();
+
+    /** Create a sampler
+    * @param method is the sampling method (stride, random, reservoir, voxel, farthest or curvature)
+    * @return a new sampler, nullptr if the method is unknown
+    */
+    /****************************************************************/
+    static PointSampler *create(const std::string &method);
+
+    /** Check if a sampling method is known
+    * @param method is the sampling method
+    * @return true if create accepts it
+    */
+    /****************************************************************/
+    static bool isValid(const std::string &method);
+
+    /** Select the points
+    * @param point_cloud is the point cloud, its points used for the estimation are sampled
+    * @param desired_points is the number of points to be selected
+    * @param indices is filled with the increasing indices of the selected points,
+    *        all the points if they are no more than desired_points
+    */
+    /****************************************************************/
+    virtual void sample(const PointCloud &point_cloud, const int &desired_points, std::vector<int> &indices) const = 0;
+};
+
+/**
+* \class SuperqModel::StrideSampler
+* \headerfile pointSampler.h <SuperquadricModel/include/pointSampler.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class selects equally spaced points, in the order of the point cloud.
+*/
+class StrideSampler : public PointSampler
+{
+public:
+
+    /****************************************************************/
+    void sample(const PointCloud &point_cloud, const int &desired_points, std::vector<int> &indices) const override;
+};
+
+/**
+* \class SuperqModel::RandomSampler
+* \headerfile pointSampler.h <SuperquadricModel/include/pointSampler.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class selects uniformly random points with Floyd's algorithm: one draw per
+* selected point, independently of the size of the point cloud.
+*/
+class RandomSampler : public PointSampler
+{
+public:
+
+    RandomSampler(const unsigned int &s = 1);
+
+    /****************************************************************/
+    void sample(const PointCloud &point_cloud, const int &desired_points, std::vector<int> &indices) const override;
+};
+
+/**
+* \class SuperqModel::ReservoirSampler
+* \headerfile pointSampler.h <SuperquadricModel/include/pointSampler.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class selects uniformly random points with reservoir sampling, scanning the
+* point cloud once and skipping the points that would not enter the reservoir
+* (Li's algorithm L), e.g. for streams whose size is not known in advance.
+*/
+class ReservoirSampler : public PointSampler
+{
+public:
+
+    ReservoirSampler(const unsigned int &s = 1);
+
+    /****************************************************************/
+    void sample(const PointCloud &point_cloud, const int &desired_points, std::vector<int> &indices) const override;
+};
+
+/**
+* \class SuperqModel::VoxelGridSampler
+* \headerfile pointSampler.h <SuperquadricModel/include/pointSampler.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class keeps one point for each cell of a voxel grid, so that the selected
+* points cover the object uniformly also if the density of the point cloud is not.
+* The cells are stored in a hash table and their size is adjusted until the number
+* of occupied cells is close to the desired number of points.
+*/
+class VoxelGridSampler : public PointSampler
+{
+    /** Find the occupied cells and keep the first point of each of them
+    * @param point_cloud is the point cloud
+    * @param origin is the minimum corner of the grid
+    * @param cell is the size of the cells
+    * @param max_cells is the maximum number of cells
+    * @param keys is the hash table of the cell keys, size power of 2 and at least 2*max_cells
+    * @param cells is filled with the index of the first point of each cell
+    * @return false if the points occupy more than max_cells cells
+    */
+    /****************************************************************/
+    bool fillGrid(const PointCloud &point_cloud, const Eigen::Vector3d &origin, const double &cell,
+                  const int &max_cells, std::vector<unsigned long long> &keys, std::vector<int> &cells) const;
+
+public:
+
+    /****************************************************************/
+    void sample(const PointCloud &point_cloud, const int &desired_points, std::vector<int> &indices) const override;
+};
+
+/**
+* \class SuperqModel::FarthestPointSampler
+* \headerfile pointSampler.h <SuperquadricModel/include/pointSampler.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class selects each point as the farthest from the ones already selected, so
+* that thin parts of the object are covered also with few points. Large point clouds
+* are first reduced with a voxel grid to a multiple of the desired points, bounded,
+* so that the cost does not depend on their size.
+*/
+class FarthestPointSampler : public PointSampler
+{
+    static const int candidates_per_point = 32;
+    static const int min_candidates = 4096;
+    static const int max_candidates = 32768;
+
+public:
+
+    /****************************************************************/
+    void sample(const PointCloud &point_cloud, const int &desired_points, std::vector<int> &indices) const override;
+};
+
+/**
+* \class SuperqModel::CurvatureSampler
+* \headerfile pointSampler.h <SuperquadricModel/include/pointSampler.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class selects random points with a probability that grows with the local
+* surface variation and with the distance from the centroid of the neighbors, so
+* that edges, corners and boundaries are preferred to flat regions. The neighbors
+* are found with a VoxelHash on the points reduced by a voxel grid, as in FarthestPointSampler.
+*/
+class CurvatureSampler : public PointSampler
+{
+    static const int candidates_per_point = 16;
+    static const int min_candidates = 2048;
+    static const int max_candidates = 32768;
+    constexpr static double min_weight = 0.2;
+
+public:
+
+    CurvatureSampler(const unsigned int &s = 1);
+
+    /****************************************************************/
+    void sample(const PointCloud &point_cloud, const int &desired_points, std::vector<int> &indices) const override;
+};
+
+}
+
+#endif
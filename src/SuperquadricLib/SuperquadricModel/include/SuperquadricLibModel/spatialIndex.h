@@ -0,0 +1,246 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+
+ /**
+  * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+  */
+
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+#include <vector>
+
+namespace SuperqModel {
+
+class ThreadPool;
+
+typedef std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> Points3d;
+
+/**
+* \class SuperqModel::KdTree
+* \headerfile spatialIndex.h <SuperquadricModel/include/spatialIndex.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class is a balanced KD-tree for nearest neighbors and radius queries. Each node
+* splits its points in two halves along the axis of largest extent, so the tree shape
+* only depends on the number of points: the nodes are stored in a flat array in heap
+* order, without pointers, and the points are stored in tree order, so that the points
+* of a leaf are contiguous. The queries return the indices of the points as given to
+* the constructor. The tree is not modified after construction, so it can be queried
+* by many threads at once.
+*/
+class KdTree
+{
+    static const int leaf_size = 16;
+
+    // Points in tree order and their original indices
+    Points3d points;
+    std::vector<int> ids;
+    // Split value and axis of the internal nodes, node k has children 2k+1 and 2k+2
+    std::vector<double> splits;
+    std::vector<unsigned char> axes;
+    int depth;
+
+    /** Build a subtree
+    * @param node is the index of the subtree root
+    * @param begin is the first point of the subtree
+    * @param end is past the last point of the subtree
+    * @param level is the depth of node
+    * @param source are the points given to the constructor
+    * @param pool runs the large subtrees concurrently, nullptr for building them here
+    */
+    /*********************************************/
+    void build(const int &node, const int &begin, const int &end, const int &level,
+               const Points3d &source, ThreadPool *pool);
+
+    /** Search the k nearest points in a subtree
+    * @param node is the index of the subtree root
+    * @param begin is the first point of the subtree
+    * @param end is past the last point of the subtree
+    * @param level is the depth of node
+    * @param query is the query point
+    * @param k is the number of neighbors
+    * @param heap is a max-heap of the best squared distances and indices found so far
+    */
+    /*********************************************/
+    void searchKnn(const int &node, const int &begin, const int &end, const int &level, const Eigen::Vector3d &query,
+                   const int &k, std::vector<std::pair<double, int>> &heap) const;
+
+    /** Search the points within a radius in a subtree
+    * @param node is the index of the subtree root
+    * @param begin is the first point of the subtree
+    * @param end is past the last point of the subtree
+    * @param level is the depth of node
+    * @param query is the query point
+    * @param sq_radius is the squared radius
+    * @param indices is filled with the indices of the points found
+    */
+    /*********************************************/
+    void searchRadius(const int &node, const int &begin, const int &end, const int &level, const Eigen::Vector3d &query,
+                      const double &sq_radius, std::vector<int> &indices) const;
+
+public:
+
+    /** Constructor
+    * @param p are the points, copied in the tree
+    * @param n_threads is the number of threads building the tree, 0 for the number of hardware threads
+    */
+    KdTree(const Points3d &p, const int &n_threads = 1);
+
+    /** Get the number of points
+    * @return the number of points
+    */
+    /*********************************************/
+    int size() const;
+
+    /** Find the k nearest points
+    * @param query is the query point
+    * @param k is the number of neighbors
+    * @param indices is filled with the indices of the neighbors, closest first
+    * @param sq_distances is filled with their squared distances from query
+    */
+    /*********************************************/
+    void knnSearch(const Eigen::Vector3d &query, const int &k, std::vector<int> &indices, std::vector<double> &sq_distances) const;
+
+    /** Find the points within a radius
+    * @param query is the query point
+    * @param radius is the radius
+    * @param indices is filled with the indices of the points, in no particular order
+    */
+    /*********************************************/
+    void radiusSearch(const Eigen::Vector3d &query, const double &radius, std::vector<int> &indices) const;
+
+    /** Find the nearest point
+    * @param query is the query point
+    * @param sq_distance is filled with its squared distance from query
+    * @return the index of the nearest point, -1 if the tree is empty
+    */
+    /*********************************************/
+    int nearest(const Eigen::Vector3d &query, double &sq_distance) const;
+};
+
+/**
+* \class SuperqModel::VoxelHash
+* \headerfile spatialIndex.h <SuperquadricModel/include/spatialIndex.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class groups the points in the cubic cells of a grid, stored in a hash table,
+* for radius queries with a radius close to the cell size, e.g. the neighborhoods of
+* all the points. The cells are sorted by their coordinates and the points of a cell
+* are contiguous. The queries return the indices of the points as given to the
+* constructor.
+*/
+class VoxelHash
+{
+    double cell;
+    Eigen::Vector3d origin;
+    Eigen::Vector3i dims;
+    // Points sorted by cell and their original indices
+    Points3d points;
+    std::vector<int> ids;
+    // Hash table of the keys of the occupied cells and their indices, with the range of their points
+    std::vector<std::pair<unsigned long long, int>> table;
+    std::vector<int> cell_starts;
+    std::vector<unsigned long long> cell_keys;
+    int shift;
+
+    /** Find a cell in the hash table
+    * @param key is the key of the cell
+    * @return the index of the cell, -1 if it is empty
+    */
+    /*********************************************/
+    int findCell(const unsigned long long &key) const;
+
+public:
+
+    /** Constructor
+    * @param p are the points, copied in the grid
+    * @param cell_size is the size of the cells, enlarged if the grid would have more than 2^21 cells per side
+    */
+    VoxelHash(const Points3d &p, const double &cell_size);
+
+    /** Get the number of points
+    * @return the number of points
+    */
+    /*********************************************/
+    int size() const;
+
+    /** Get the size of the cells
+    * @return the size
+    */
+    /*********************************************/
+    double getCellSize() const;
+
+    /** Get the number of occupied cells
+    * @return the number of cells
+    */
+    /*********************************************/
+    int getNumberCells() const;
+
+    /** Get the points of a cell
+    * @param c is the index of the cell, in [0, getNumberCells())
+    * @param begin is filled with the position of its first point
+    * @param end is filled with the position past its last point
+    */
+    /*********************************************/
+    void getCellRange(const int &c, int &begin, int &end) const;
+
+    /** Get the index of a point in the order of the cells
+    * @param j is the position of the point, in [0, size())
+    * @return the index of the point as given to the constructor
+    */
+    /*********************************************/
+    int getIndex(const int &j) const;
+
+    /** Get a point in the order of the cells
+    * @param j is the position of the point, in [0, size())
+    * @return the point
+    */
+    /*********************************************/
+    const Eigen::Vector3d &getPoint(const int &j) const;
+
+    /** Find the occupied cells close to a range of cells, the cells being sorted
+    * so that the cells close to consecutive ones are found in a single sweep
+    * @param begin is the first cell of the range
+    * @param end is past the last cell of the range
+    * @param radius is the maximum distance between two cells
+    * @param cells is filled with the indices of the cells close to each cell of the
+    *        range, itself included
+    * @param starts is filled with the position in cells of the first cell close to
+    *        each cell of the range, followed by the size of cells
+    */
+    /*********************************************/
+    void neighborCells(const int &begin, const int &end, const double &radius,
+                       std::vector<int> &cells, std::vector<int> &starts) const;
+
+    /** Find the points within a radius
+    * @param query is the query point
+    * @param radius is the radius
+    * @param indices is filled with the indices of the points, in no particular order
+    */
+    /*********************************************/
+    void radiusSearch(const Eigen::Vector3d &query, const double &radius, std::vector<int> &indices) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,169 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+
+ /**
+  * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+  */
+
+#ifndef SUPERQKERNEL_H
+#define SUPERQKERNEL_H
+
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+#include <deque>
+#include <vector>
+
+#include <SuperquadricLibModel/pointCloud.h>
+#include <SuperquadricLibModel/superquadric.h>
+
+typedef Eigen::Matrix<double, 11, 11> Matrix11d;
+
+namespace SuperqModel {
+
+/**
+* \class SuperqModel::PointsSoA
+* \headerfile superqKernel.h <SuperquadricModel/include/superqKernel.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class stores a block of 3D points as a structure of arrays (x[], y[], z[]),
+* so that the superquadric functions can be evaluated on all of them at once.
+*/
+class PointsSoA
+{
+public:
+
+    Eigen::ArrayXd x;
+    Eigen::ArrayXd y;
+    Eigen::ArrayXd z;
+
+    /**
+     * Set the points of the block
+     * @param p is a vector of 3d eigen vectors
+     */
+    void setPoints(const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> &p);
+
+    /**
+     * Set the points of the block
+     * @param p is a deque of 3d eigen vectors
+     */
+    void setPoints(const std::deque<Eigen::Vector3d> &p);
+
+    /**
+     * Set the points of the block
+     * @param p is a point cloud, its points used for the estimation are copied
+     */
+    void setPoints(const SuperqModel::PointCloud &p);
+
+    /**
+     * Get the number of points of the block
+     * @return the number of points
+     */
+    int size() const;
+
+    /**
+     * Apply a rigid transformation to all the points
+     * @param R is the rotation matrix
+     * @param t is the translation vector
+     * @param out is the block where the transformed points are stored
+     */
+    void transform(const Eigen::Matrix3d &R, const Eigen::Vector3d &t, PointsSoA &out) const;
+};
+
+/**
+* \class SuperqModel::SuperqKernel
+* \headerfile superqKernel.h <SuperquadricModel/include/superqKernel.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class collects the batch evaluation of the superquadric inside-outside function
+* and of the fitting cost on a block of points. The rotation is computed once per parameter
+* vector and the points are processed with Eigen array expressions, which are vectorized
+* with the SIMD instruction set the library is compiled for (SSE, AVX/AVX2) and fall back
+* to scalar code otherwise.
+*/
+class SuperqKernel
+{
+public:
+
+    /**
+     * Compute the rotation matrix of a superquadric
+     * @param params are the 11 superquadric parameters (ZYZ Euler angles in the last 3 entries)
+     * @return the 3x3 rotation matrix
+     */
+    static Eigen::Matrix3d rotation(const Vector11d &params);
+
+    /**
+     * Evaluate the inside-outside function on a block of points
+     * @param params are the 11 superquadric parameters (only dimensions, exponents and center are used)
+     * @param R is the superquadric orientation
+     * @param points is the block of points
+     * @param values is filled with the values of the inside-outside function
+     */
+    static void insideOutside(const Vector11d &params, const Eigen::Matrix3d &R,
+                              const PointsSoA &points, Eigen::ArrayXd &values);
+
+    /**
+     * Evaluate the inside-outside function on a block of points
+     * @param params are the 11 superquadric parameters
+     * @param points is the block of points
+     * @param values is filled with the values of the inside-outside function
+     */
+    static void insideOutside(const Vector11d &params, const PointsSoA &points, Eigen::ArrayXd &values);
+
+    /**
+     * Compute the superquadric fitting cost a1*a2*a3/N * sum_i (F_i^e1 - 1)^2
+     * @param params are the 11 superquadric parameters
+     * @param points is the block of points
+     * @return the cost value
+     */
+    static double cost(const Vector11d &params, const PointsSoA &points);
+
+    /**
+     * Compute the residuals r_i = F_i^e1 - 1 and their derivatives w.r.t. the 11 parameters
+     * @param params are the 11 superquadric parameters
+     * @param points is the block of points
+     * @param r is filled with the residuals
+     * @param J is filled with the Nx11 jacobian of the residuals
+     */
+    static void residualJacobian(const Vector11d &params, const PointsSoA &points,
+                                 Eigen::ArrayXd &r, Eigen::MatrixXd &J);
+
+    /**
+     * Compute the superquadric fitting cost and its analytic gradient
+     * @param params are the 11 superquadric parameters
+     * @param points is the block of points
+     * @param grad is filled with the gradient of the cost
+     * @return the cost value
+     */
+    static double costGradient(const Vector11d &params, const PointsSoA &points, Vector11d &grad);
+
+    /**
+     * Compute the superquadric fitting cost and its exact hessian, obtained by forward
+     * automatic differentiation of the analytic gradient
+     * @param params are the 11 superquadric parameters
+     * @param points is the block of points
+     * @param hess is filled with the 11x11 hessian of the cost
+     * @return the cost value
+     */
+    static double costHessian(const Vector11d &params, const PointsSoA &points, Matrix11d &hess);
+};
+
+}
+
+#endif
@@ -0,0 +1,196 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+
+ /**
+  * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+  */
+
+#ifndef SUPERQSOLVER_H
+#define SUPERQSOLVER_H
+
+#include <mutex>
+#include <string>
+
+#include <IpIpoptApplication.hpp>
+
+#include <SuperquadricLibModel/options.h>
+#include <SuperquadricLibModel/superquadricEstimator.h>
+
+namespace SuperqModel {
+
+/**
+* \class SuperqModel::IpoptSession
+* \headerfile superqSolver.h <SuperquadricModel/include/superqSolver.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class keeps an IpoptApplication configured and initialized, so that it can be
+* used for many optimizations. The application is built again only if the options change.
+*/
+class IpoptSession
+{
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app;
+    IpoptParam session_pars;
+    bool with_constraints;
+    double setup_time;
+    double setup_time_saved;
+    int reuses;
+
+    /** Check if the options used by Ipopt are the same
+    * @param pars are the new optimization parameters
+    * @return true if the current application can be used with pars
+    */
+    /****************************************************************/
+    bool sameOptions(const IpoptParam &pars) const;
+
+public:
+
+    /** Constructor
+    * @param constraints is true if the problems have constraints, so that constr_tol is used
+    */
+    IpoptSession(const bool &constraints = false);
+
+    /** Get the application configured with the given parameters
+    * @param pars are the optimization parameters
+    * @return the application, created and initialized only if needed
+    */
+    /****************************************************************/
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> get(const IpoptParam &pars);
+
+    /** Get the setup time saved by reusing the application
+    * @return the saved time [s], estimated with the cost of the last setup
+    */
+    /****************************************************************/
+    double getSetupTimeSaved() const;
+
+    /** Get how many times the application has been reused
+    * @return the number of reuses
+    */
+    /****************************************************************/
+    int getReuses() const;
+
+    /** Get the mutex serializing the Ipopt optimizations of the process. The default
+    * linear solver of Ipopt (MUMPS) is not reentrant, hence two applications must not
+    * optimize at the same time, also if they belong to different threads
+    * @return the mutex, to be held during OptimizeTNLP
+    */
+    /****************************************************************/
+    static std::mutex &optimizationMutex();
+};
+
+/**
+* \class SuperqModel::SuperqSolver
+* \headerfile superqSolver.h <SuperquadricModel/include/superqSolver.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class is the interface of the solvers used for estimating a single superquadric.
+* The problem (points, starting point and bounds) is described by a SuperqEstimator.
+*/
+class SuperqSolver
+{
+protected:
+    int iterations;
+    /* True if the solver runs concurrently with other solvers of the process */
+    bool concurrent;
+
+public:
+
+    SuperqSolver();
+
+    virtual ~SuperqSolver();
+
+    /** Create a solver
+    * @param name is the solver name (ipopt or levenberg-marquardt)
+    * @param concurrent is true if the solver is used by one of many threads solving at the same time
+    * @return a new solver, ipopt if the name is unknown
+    */
+    /****************************************************************/
+    static SuperqSolver *create(const std::string &name, const bool &concurrent = false);
+
+    /** Solve the problem and store the result in the estimator
+    * @param pars are the optimization parameters
+    * @param estim is the problem to be solved
+    * @return the outcome of the optimization, with the same meaning as in Ipopt
+    */
+    /****************************************************************/
+    virtual Ipopt::ApplicationReturnStatus solve(const IpoptParam &pars, const Ipopt::SmartPtr<SuperqEstimator> &estim) = 0;
+
+    /** Get the number of iterations of the last solve
+    * @return the iteration count
+    */
+    /****************************************************************/
+    int getIterations() const;
+
+    /** Get the setup time saved by reusing the solver session
+    * @return the saved time [s]
+    */
+    /****************************************************************/
+    virtual double getSetupTimeSaved() const;
+};
+
+/**
+* \class SuperqModel::IpoptSuperqSolver
+* \headerfile superqSolver.h <SuperquadricModel/include/superqSolver.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class solves the superquadric estimation with the Ipopt interior point method.
+* The same IpoptApplication is used for all the problems solved by an instance.
+* The optimizations are serialized over the whole process, see IpoptSession::optimizationMutex,
+* so that the estimations run on many threads are concurrent only with levenberg-marquardt.
+* The time of each optimization is limited by the max_cpu_time option of Ipopt, or by
+* max_cpu_time as wall time from when it starts if the solver is concurrent, since the cpu
+* time of the process also counts the other threads.
+*/
+class IpoptSuperqSolver : public SuperqSolver
+{
+    IpoptSession session;
+    /* Session with warm start options, used when tracking */
+    IpoptSession warm_session;
+
+public:
+
+    /****************************************************************/
+    Ipopt::ApplicationReturnStatus solve(const IpoptParam &pars, const Ipopt::SmartPtr<SuperqEstimator> &estim);
+
+    /****************************************************************/
+    double getSetupTimeSaved() const;
+};
+
+/**
+* \class SuperqModel::LevenbergMarquardtSolver
+* \headerfile superqSolver.h <SuperquadricModel/include/superqSolver.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class solves the superquadric estimation as a bound-constrained nonlinear least-squares problem
+* with a projected Levenberg-Marquardt method, using the jacobian of the residuals directly.
+* Variables lying on a bound and pushed outside by the gradient are kept fixed in each step.
+*/
+class LevenbergMarquardtSolver : public SuperqSolver
+{
+public:
+
+    /****************************************************************/
+    Ipopt::ApplicationReturnStatus solve(const IpoptParam &pars, const Ipopt::SmartPtr<SuperqEstimator> &estim);
+};
+
+}
+
+#endif
@@ -29,6 +29,8 @@ typedef Eigen::Matrix<double, 11, 1> Vector11d;
 
 namespace SuperqModel {
 
+class PointsSoA;
+
 /**
 * \class SuperqModel::Superquadric
 * \headerfile superquadric.h <SuperquadricModel/include/superquadric.h>
@@ -162,6 +164,16 @@ public:
      * @return the value of the inside-outside function
      */
     double insideOutsideF(const Eigen::VectorXd &pose, const Eigen::Vector3d &point) const;
+
+    /**
+     * Compute the inside-outside function of the superquadric on a block of points,
+     * computing the orientation given by the pose only once
+     * @param pose is the pose of the superquadric
+     * @param points is the block of points where we want to evaluate the inside-outside function
+     * @param values is filled with the values of the inside-outside function
+     * @return false if the pose vector has wrong dimensions
+     */
+    bool insideOutsideF(const Eigen::VectorXd &pose, const PointsSoA &points, Eigen::ArrayXd &values) const;
 };
 
 }
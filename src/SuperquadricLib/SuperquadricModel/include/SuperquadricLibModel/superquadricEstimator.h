@@ -27,16 +27,27 @@
 #include <IpIpoptApplication.hpp>
 #include <IpReturnCodes.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+
 #include <SuperquadricLibModel/superquadric.h>
 #include <SuperquadricLibModel/pointCloud.h>
 #include <SuperquadricLibModel/tree.h>
 #include <SuperquadricLibModel/options.h>
+#include <SuperquadricLibModel/superqKernel.h>
 
 typedef Eigen::Matrix<double, 11, 2>  Matrix112d;
 typedef Eigen::Matrix<double, 3, 2>  Matrix32d;
 
 namespace SuperqModel {
 
+class SuperqSolver;
+class ThreadPool;
+
 /**
 * \class SuperqModel::Superq_NLP
 * \headerfile superqEstimator.h <SuperquadricModel/include/superqEstimator.h>
@@ -52,7 +63,18 @@ protected:
     Matrix112d bounds;
     std::string obj_class;
     double aux_objvalue;
+    Vector11d aux_grad;
+    bool aux_valid;
+    bool warm_start;
+    Matrix112d warm_bounds;
+    Vector11d z_lower;
+    Vector11d z_upper;
     int used_points;
+    const std::atomic<bool> *cancel_flag;
+    /* Wall time limit of the optimization, checked at each Ipopt iteration */
+    bool time_limited;
+    bool time_expired;
+    std::chrono::steady_clock::time_point deadline;
 
     /** Get info for the nonlinear problem to be solved with ipopt
     * @param n is the dimension of the variable
@@ -111,40 +133,35 @@ protected:
     bool eval_f(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
                    Ipopt::Number &obj_value);
 
-    /** Auxiliary function for computing cost function of the nonlinear problem to be solved with ipopt
+    /** Auxiliary function for computing cost function and gradient of the nonlinear problem to be solved with ipopt
     * @param x is the variable
-    * @param points_on is object point cloud
     * @param new_x takes into account is the variable has been updated or not
-    * @retun the cost function value
     */
     /****************************************************************/
     void F(const Ipopt::Number *x, bool &new_x);
 
-    /** Auxiliary function for computing cost function of the nonlinear problem to be solved with ipopt
-    * @param obj is the Vector of the object
+    /** Auxiliary function for computing the cost function of the nonlinear problem
     * @param x is the variable
-    * @param point is one point of the point cloud
-    * @return a part of the cost function value
+    * @return cost function value
     */
     /****************************************************************/
-    double f(const Ipopt::Number *x, const Eigen::Vector3d &point);
+    double F_v(const Vector11d &x);
 
-    /** Auxiliary function for computing the gradient of cost function of the nonlinear problem
+    /** Compute cost function and its analytic gradient with a single pass on the points
     * @param x is the variable
-    * @param points_on is one point of object point cloud
+    * @param grad is the gradient of the cost function
     * @return cost function value
     */
     /****************************************************************/
-    double F_v(const Vector11d &x);
+    double F_grad(const Vector11d &x, Vector11d &grad);
 
-    /** Auxiliary function for computing the gradient cost function of the nonlinear problem
-    * @param obj is the Vector of the object
+    /** Compute cost function and its exact hessian
     * @param x is the variable
-    * @param point is one point of the point cloud
-    * @return a part of the cost function value
+    * @param hess is the hessian of the cost function
+    * @return cost function value
     */
     /****************************************************************/
-    double f_v(const Vector11d &x, const Eigen::Vector3d &point);
+    double F_hess(const Vector11d &x, Matrix11d &hess);
 
     /** Gradient of the cost function of the nonlinear problem
     * @param x is the variable
@@ -156,6 +173,26 @@ protected:
     bool eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
                      Ipopt::Number *grad_f);
 
+    /** Hessian of the lagrangian of the nonlinear problem (lower triangle)
+    * @param n is the dimension of the variable
+    * @param x is the variable
+    * @param new_x takes into account is the variable has been updated or not
+    * @param obj_factor is the factor of the cost function
+    * @param m is the number of constraints
+    * @param lambda are the constraint multipliers
+    * @param new_lambda takes into account is lambda has been updated or not
+    * @param nele_hess is the number of nonzero elements
+    * @param iRow contains the hessian raws
+    * @param jCol contains the hessian columns
+    * @param values contains the hessian values
+    * @return true
+    */
+    /****************************************************************/
+    bool eval_h(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                Ipopt::Number obj_factor, Ipopt::Index m, const Ipopt::Number *lambda,
+                bool new_lambda, Ipopt::Index nele_hess, Ipopt::Index *iRow,
+                Ipopt::Index *jCol, Ipopt::Number *values);
+
     /** Constraints of the nonlinear problem
     * @param n is the dimension of the variable
     * @param x is the variable
@@ -208,22 +245,62 @@ protected:
                            const Ipopt::Number *g, const Ipopt::Number *lambda,
                            Ipopt::Number obj_value, const Ipopt::IpoptData *ip_data,
                            Ipopt::IpoptCalculatedQuantities *ip_cq);
+
+    /** Called by ipopt at each iteration, used for stopping the optimization when cancelled
+    * or when the time limit expires
+    * @param iter is the current iteration
+    * @param obj_value is the current cost function value
+    * @return false if the optimization has to be stopped
+    */
+    /****************************************************************/
+    bool intermediate_callback(Ipopt::AlgorithmMode mode, Ipopt::Index iter, Ipopt::Number obj_value,
+                               Ipopt::Number inf_pr, Ipopt::Number inf_du, Ipopt::Number mu,
+                               Ipopt::Number d_norm, Ipopt::Number regularization_size,
+                               Ipopt::Number alpha_du, Ipopt::Number alpha_pr, Ipopt::Index ls_trials,
+                               const Ipopt::IpoptData *ip_data, Ipopt::IpoptCalculatedQuantities *ip_cq);
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
     SuperqModel::Superquadric solution;
     SuperqModel::PointCloud points_downsampled;
+    SuperqModel::PointsSoA points_soa;
 
     /** Init function */
     /****************************************************************/
     void init();
 
-    /** Set point to be used for superquadric estimation
+    /** Set point to be used for superquadric estimation, the point cloud is not modified:
+    * points_downsampled is a view of its points
+    * @param point_cloud is the object point cloud
+    * @param optimizer_points is the maximum number of points to be used for the optimization problem
+    */
+    /****************************************************************/
+    void setPoints(const SuperqModel::PointCloud &point_cloud, const int &optimizer_points, const bool &random);
+
+    /** Set point to be used for superquadric estimation, the point cloud is not modified:
+    * points_downsampled is a view of its points
     * @param point_cloud is the object point cloud
     * @param optimizer_points is the maximum number of points to be used for the optimization problem
+    * @param sampling_method is the downsampling method, see PointSampler
+    */
+    /****************************************************************/
+    void setPoints(const SuperqModel::PointCloud &point_cloud, const int &optimizer_points, const std::string &sampling_method);
+
+    /** Compare the analytic gradient with central finite differences
+    * @param x is the point where the gradient is checked
+    * @param eps is the finite difference step
+    * @return the maximum relative error among the gradient components
+    */
+    /****************************************************************/
+    double checkGradient(const Vector11d &x, const double &eps = 1e-6);
+
+    /** Compare the exact hessian with central finite differences of the gradient
+    * @param x is the point where the hessian is checked
+    * @param eps is the finite difference step
+    * @return the maximum relative error among the hessian entries
     */
     /****************************************************************/
-    void setPoints(SuperqModel::PointCloud &point_cloud, const int &optimizer_points, const bool &random);
+    double checkHessian(const Vector11d &x, const double &eps = 1e-6);
 
     /** Configure function
     * @param rf is the resource finder
@@ -233,6 +310,84 @@ public:
     /****************************************************************/
     void configure(const std::string &object_class);
 
+    /** Get the starting point and the bounds of the problem, for solvers not using the TNLP interface
+    * @param x_start is the initial value of the variable
+    * @param x_bounds are the lower (first column) and upper (second column) bounds of the variable
+    */
+    /****************************************************************/
+    void getProblem(Vector11d &x_start, Matrix112d &x_bounds);
+
+    /** Compute the residuals and their jacobian, such that the cost function is their squared norm
+    * @param x is the variable
+    * @param rho is filled with the scaled residuals
+    * @param J is filled with the jacobian of the scaled residuals
+    * @return cost function value
+    */
+    /****************************************************************/
+    double residuals(const Vector11d &x, Eigen::ArrayXd &rho, Eigen::MatrixXd &J);
+
+    /** Start from a previous estimate, with bounds tightened around it.
+    * To be called after setPoints
+    * @param x_prev is the previous superquadric
+    * @param z_L are the multipliers of the lower bounds of the previous problem
+    * @param z_U are the multipliers of the upper bounds of the previous problem
+    */
+    /****************************************************************/
+    void setWarmStart(const Vector11d &x_prev, const Vector11d &z_L, const Vector11d &z_U);
+
+    /** Start from a given superquadric, keeping the bounds computed from the points.
+    * To be called after setPoints
+    * @param x_init is the initial superquadric, clipped to the bounds
+    */
+    /****************************************************************/
+    void setInitialGuess(const Vector11d &x_init);
+
+    /** Get the bound multipliers of the solution
+    * @param z_L are the multipliers of the lower bounds
+    * @param z_U are the multipliers of the upper bounds
+    */
+    /****************************************************************/
+    void getMultipliers(Vector11d &z_L, Vector11d &z_U) const;
+
+    /** Evaluate the cost function on the points of the problem
+    * @param x is the variable
+    * @return cost function value
+    */
+    /****************************************************************/
+    double cost(const Vector11d &x);
+
+    /** Set a flag for stopping the optimization from another thread
+    * @param flag is checked at each iteration, nullptr for never stopping
+    */
+    /****************************************************************/
+    void setCancelFlag(const std::atomic<bool> *flag);
+
+    /** Check if the optimization has been cancelled
+    * @return true if the cancel flag is set
+    */
+    /****************************************************************/
+    bool cancelled() const;
+
+    /** Limit the wall time of the next optimization, which stops at the first
+    * iteration after it expires. Unlike the cpu time of the process, it does not
+    * count the optimizations running concurrently on other threads
+    * @param seconds is the time limit [s], starting now
+    */
+    /****************************************************************/
+    void setTimeLimit(const double &seconds);
+
+    /** Check if the last optimization was stopped by the time limit
+    * @return true if the time limit expired
+    */
+    /****************************************************************/
+    bool timeExpired() const;
+
+    /** Set the solution of the problem
+    * @param x is the estimated variable
+    */
+    /****************************************************************/
+    void setSolution(const Vector11d &x);
+
     /** Extract the solution
     * @return the superquadric as a Vector
     */
@@ -244,21 +399,151 @@ public:
 class SuperqEstimatorApp : public Options
 {
     int h_tree;
-    PointCloud *point_cloud_split1;
-    PointCloud *point_cloud_split2;
+    int last_iterations;
+    /* Solver iterations of all the fits of the last computeMultipleSuperq */
+    std::atomic<int> tree_iterations;
+
+    /* Solver session, reused until the solver option changes */
+    std::shared_ptr<SuperqSolver> solver;
+    std::string solver_name;
+    double setup_time_saved;
+
+    /* Last estimate in tracking mode */
+    bool tracking_valid;
+    SuperqModel::Superquadric tracked_superq;
+    double tracked_cost;
+    Vector11d tracked_z_L;
+    Vector11d tracked_z_U;
+    int cold_starts;
+
+    /* Time of each estimation of the last batch */
+    std::vector<double> batch_times;
+
+    /* Re-fit of the merge phase still to be solved, with the points of the right
+       and left children of a node of the new tree, split by the plane of old_node */
+    struct MergeRefit
+    {
+        SuperqModel::PointCloud *right_points;
+        SuperqModel::PointCloud *left_points;
+        const SuperqModel::node *old_node;
+    };
+
+    /* Re-fits of the merge phase for each node of the new tree */
+    std::map<SuperqModel::node*, MergeRefit> merge_refits;
+
+    /* View of the points of the last computeMultipleSuperq, root of the tree */
+    SuperqModel::PointCloud root_points;
 
 protected:
+    /** Estimate a single superquadric
+    * @param point_cloud is the object point cloud
+    * @param tracking is true for starting from the last estimate of trackSuperq
+    * @return the estimated superquadric
+    */
+    /***********************************************************************/
+    std::vector<SuperqModel::Superquadric> estimateSuperq(const SuperqModel::PointCloud &point_cloud, const bool &tracking);
+
+    /** Create the solver if missing or if the solver option changed */
+    /***********************************************************************/
+    void updateSolver();
+
+    /** Create the problem of a single superquadric
+    * @param point_cloud is the object point cloud, downsampled if needed
+    * @param log is the stream where the messages are printed
+    * @return the problem
+    */
+    /***********************************************************************/
+    Ipopt::SmartPtr<SuperqEstimator> setupProblem(const SuperqModel::PointCloud &point_cloud, std::ostream &log) const;
+
+    /** Solve the problem of a single superquadric and print the outcome.
+    * The state of the class is not modified, so that it can be called concurrently
+    * @param estim is the problem
+    * @param task_solver is the solver, used by one thread at a time
+    * @param solve_pars are the optimization parameters
+    * @param log is the stream where the messages are printed
+    * @param status is filled with the outcome of the optimization
+    * @return the estimated superquadric, with null parameters if no solution is found
+    */
+    /***********************************************************************/
+    SuperqModel::Superquadric solveSuperq(const Ipopt::SmartPtr<SuperqEstimator> &estim, SuperqModel::SuperqSolver &task_solver,
+                                          const IpoptParam &solve_pars, std::ostream &log,
+                                          Ipopt::ApplicationReturnStatus &status) const;
+
+    /** Tell that the concurrent estimations run one at a time, if the solver is ipopt
+    */
+    /***********************************************************************/
+    void logSerialSolver() const;
+
+    /** Compute the residual of a solution independent of the superquadric size
+    * @param estim is the problem
+    * @param superq is the solution
+    * @param status is the outcome of the optimization
+    * @return the cost divided by the volume factor, infinity if no solution was found
+    */
     /***********************************************************************/
-    void iterativeModeling(SuperqModel::PointCloud &point_cloud);
+    double normalizedResidual(const Ipopt::SmartPtr<SuperqEstimator> &estim, const SuperqModel::Superquadric &superq,
+                              const Ipopt::ApplicationReturnStatus &status) const;
+
+    /***********************************************************************/
+    void iterativeModeling(const SuperqModel::PointCloud &point_cloud);
+
+    /** Check if the points of a node are split and fitted by its children. All the nodes
+    * above the maximum height are split, or only the ones whose superquadric does not fit
+    * the points with adaptive_splitting
+    * @param leaf is the node
+    * @return true if the node is split
+    */
+    /***********************************************************************/
+    bool splitNeeded(const SuperqModel::node *leaf) const;
 
     /***********************************************************************/
     void computeNestedSuperq(SuperqModel::node *newnode);
 
+    /** Split and fit a subtree as a task of the pool, the children are submitted as new tasks
+    * @param newnode is the root of the subtree
+    * @param pool is the pool running the tasks
+    * @param solvers are the solvers of the workers of the pool
+    * @param log_mutex protects the standard output
+    */
     /***********************************************************************/
-    void splitPoints(SuperqModel::node *leaf);
+    void computeNestedSuperqTask(SuperqModel::node *newnode, SuperqModel::ThreadPool &pool,
+                                 std::vector<std::shared_ptr<SuperqSolver>> &solvers, std::mutex &log_mutex);
+
+    /** Split the points of a node and fit a superquadric to each half
+    * @param newnode is the node, its children are created
+    * @param task_solver is the solver
+    * @param log is the stream where the messages are printed
+    */
+    /***********************************************************************/
+    void fitChildren(SuperqModel::node *newnode, SuperqModel::SuperqSolver &task_solver, std::ostream &log);
+
+    /** Fit a superquadric to the points of a child, starting from its father if parent_initial_guess is set.
+    * The state of the class is not modified, except for the iteration count, so that it can be called concurrently
+    * @param point_cloud are the points of the child
+    * @param parent is the superquadric fitted to the points of the father
+    * @param plane is the plane splitting the points of the father
+    * @param positive_side is true for the child on the positive side of the plane
+    * @param task_solver is the solver
+    * @param log is the stream where the messages are printed
+    * @param residual is filled with the normalized residual of the superquadric
+    * @return the estimated superquadric
+    */
+    /***********************************************************************/
+    SuperqModel::Superquadric fitChild(const SuperqModel::PointCloud &point_cloud, const SuperqModel::Superquadric &parent,
+                                       const Eigen::Vector4d &plane, const bool &positive_side,
+                                       SuperqModel::SuperqSolver &task_solver, std::ostream &log, double &residual);
+
+    /** Split the points of a node with the plane orthogonal to their principal axis,
+    * partitioning in place the indices of the points of the node
+    * @param leaf is the node
+    * @param point_cloud1 is filled with the points on the positive side of the plane
+    * @param point_cloud2 is filled with the other points
+    * @param log is the stream where the messages are printed
+    */
+    /***********************************************************************/
+    void splitPoints(SuperqModel::node *leaf, SuperqModel::PointCloud &point_cloud1,
+                     SuperqModel::PointCloud &point_cloud2, std::ostream &log);
 
-    /****************************************************************/
-    void computeSuperqAxis(SuperqModel::node *node);
 
     /****************************************************************/
     bool axisParallel(SuperqModel::node *node1, SuperqModel::node *node2, Eigen::Matrix3d &relations);
@@ -284,6 +569,19 @@ protected:
     /****************************************************************/
     void superqUsingPlane(SuperqModel::node *old_node, SuperqModel::PointCloud *pc, SuperqModel::node *newnode);
 
+    /** Drop the pending re-fit of the children of a node of the new tree
+    * @param newnode is the node whose children are replaced
+    */
+    /****************************************************************/
+    void discardMergeRefit(SuperqModel::node *newnode);
+
+    /** Solve concurrently the re-fits collected by superqUsingPlane in parallel mode
+    * @return the sum of the wall times of the single re-fits, i.e. about the time they take if serial
+    * as long as n_threads does not exceed the available cores
+    */
+    /****************************************************************/
+    double solveMergeRefits();
+
     /****************************************************************/
     std::vector<SuperqModel::Superquadric> fillSolution(SuperqModel::node *leaf);
 
@@ -294,13 +592,94 @@ public:
 
     SuperqEstimatorApp();
 
-    SuperqModel::SuperqTree *superq_tree;
-    SuperqModel::SuperqTree *superq_tree_new;
+    std::unique_ptr<SuperqModel::SuperqTree> superq_tree;
+    std::unique_ptr<SuperqModel::SuperqTree> superq_tree_new;
+
+    std::vector<SuperqModel::Superquadric> computeSuperq(const PointCloud &point_cloud);
+
+    /** Estimate a single superquadric of an object whose class is unknown.
+    * The classes listed in the object_classes option are fitted concurrently on the same
+    * downsampled points and the one with the lowest normalized residual, i.e. the cost
+    * divided by the superquadric volume term a1*a2*a3, is returned. When a class reaches
+    * a residual below class_win_residual, the classes listed after it are stopped and the first
+    * such class in object_classes is returned, so the result does not depend on the thread schedule
+    * @param point_cloud is the object point cloud, not modified
+    * @param object_class is filled with the class of the returned superquadric
+    * @return the estimated superquadric
+    */
+    /****************************************************************/
+    std::vector<SuperqModel::Superquadric> computeSuperqAutoClass(const PointCloud &point_cloud, std::string &object_class);
+
+    /** Estimate a single superquadric for each point cloud of a batch.
+    * The clouds are processed concurrently, each task with its own problem and solver,
+    * and the results do not depend on the number of threads
+    * @param point_clouds are the object point clouds, not modified
+    * @param n_threads is the number of threads, 0 for the n_threads option
+    * @return the estimated superquadrics, one for each point cloud
+    */
+    /****************************************************************/
+    std::vector<SuperqModel::Superquadric> computeSuperqBatch(const std::vector<PointCloud> &point_clouds, const int &n_threads = 0);
+
+    /** Get the time spent for each point cloud of the last batch
+    * @return the times [s], in the order of the point clouds
+    */
+    /****************************************************************/
+    const std::vector<double> &getBatchTimes() const;
+
+    /** Estimate a single superquadric of an object observed repeatedly.
+    * The solver starts from the previous estimate, with tighter bounds and warm started
+    * multipliers. A cold start is used at the first call, after resetTracking and when the
+    * cost of the previous estimate on the new points grows more than tracking_threshold times
+    * @param point_cloud is the object point cloud
+    * @return the estimated superquadric
+    */
+    /****************************************************************/
+    std::vector<SuperqModel::Superquadric> trackSuperq(const PointCloud &point_cloud);
+
+    /** Forget the last estimate of trackSuperq, so that the next call starts from scratch */
+    /****************************************************************/
+    void resetTracking();
+
+    /** Get how many times trackSuperq fell back to a cold start because of a residual jump
+    * @return the number of cold starts
+    */
+    /****************************************************************/
+    int getColdStarts() const;
+
+    /** Get the number of iterations of the last single superquadric estimation
+    * @return the iteration count reported by Ipopt
+    */
+    /****************************************************************/
+    int getLastIterations() const;
+
+    /** Get the number of iterations of all the fits of the last multiple superquadric estimation,
+    * merge re-fits included
+    * @return the sum of the iteration counts reported by the solver
+    */
+    /****************************************************************/
+    int getTreeIterations() const;
+
+    /** Cut a superquadric with a plane: the orientation and the exponents are kept, while
+    * the dimension along the axis closest to the normal of the plane and the center are
+    * changed so that the superquadric only covers one side of the plane
+    * @param parent is the superquadric
+    * @param plane is the cutting plane
+    * @param positive_side is true for keeping the positive side of the plane
+    * @param x is filled with the parameters of the cut superquadric
+    * @return false if the parent superquadric is not valid, e.g. the root of the tree
+    */
+    /***********************************************************************/
+    bool childInitialGuess(const SuperqModel::Superquadric &parent, const Eigen::Vector4d &plane,
+                           const bool &positive_side, Vector11d &x) const;
 
-    std::vector<SuperqModel::Superquadric> computeSuperq(PointCloud &point_cloud);
+    /** Get the solver setup time saved by reusing the solver sessions
+    * @return the saved time [s]
+    */
+    /****************************************************************/
+    double getSetupTimeSaved() const;
 
     /****************************************************************/
-    std::vector<SuperqModel::Superquadric> computeMultipleSuperq(PointCloud &point_cloud);
+    std::vector<SuperqModel::Superquadric> computeMultipleSuperq(const PointCloud &point_cloud);
 };
 
 
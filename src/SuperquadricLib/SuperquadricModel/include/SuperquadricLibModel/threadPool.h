@@ -0,0 +1,143 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+
+ /**
+  * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+  */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SuperqModel {
+
+/**
+* \class SuperqModel::ThreadPool
+* \headerfile threadPool.h <SuperquadricModel/include/threadPool.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class runs tasks on a fixed number of worker threads with work stealing.
+* Each worker has its own queue: tasks submitted by a worker go to its queue and
+* are executed last-in first-out, so that recursive tasks proceed depth first,
+* while idle workers steal the oldest tasks of the others. Tasks submitted from
+* outside the pool are distributed among the queues. The destructor waits for all
+* the submitted tasks.
+*/
+class ThreadPool
+{
+    struct WorkerQueue
+    {
+        std::deque<std::function<void()>> tasks;
+        std::mutex tasks_mutex;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+    /* Queued and not yet finished tasks, protected by state_mutex */
+    std::mutex state_mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    int queued;
+    int unfinished;
+    unsigned int next_queue;
+    bool stopping;
+
+    /** Loop of the worker threads
+    * @param index is the index of the worker
+    */
+    /****************************************************************/
+    void work(const int &index);
+
+    /** Take a task from the queue of a worker, or steal it from the others
+    * @param index is the index of the worker
+    * @param task is filled with the task
+    * @return true if a task has been found
+    */
+    /****************************************************************/
+    bool pop(const int &index, std::function<void()> &task);
+
+public:
+
+    /** Constructor
+    * @param n_threads is the number of worker threads, 0 for the number of hardware threads
+    */
+    ThreadPool(const int &n_threads = 0);
+
+    /** Destructor, waits for the pending tasks */
+    ~ThreadPool();
+
+    /** Get the number of worker threads
+    * @return the number of threads
+    */
+    /****************************************************************/
+    int size() const;
+
+    /** Get the index of the calling worker thread
+    * @return the index in [0, size()), -1 if the caller is not a worker of this pool
+    */
+    /****************************************************************/
+    int currentWorker() const;
+
+    /** Submit a task without result, it can be called from the tasks themselves
+    * @param task is a callable without arguments
+    */
+    /****************************************************************/
+    void run(const std::function<void()> &task);
+
+    /** Wait until all the submitted tasks, and the ones they submitted, are finished */
+    /****************************************************************/
+    void wait();
+
+    /** Submit a task
+    * @param f is a callable without arguments
+    * @return the future result of the task
+    */
+    /****************************************************************/
+    template<class F>
+    std::future<typename std::result_of<F()>::type> submit(F f)
+    {
+        typedef typename std::result_of<F()>::type R;
+
+        std::shared_ptr<std::packaged_task<R()>> task(new std::packaged_task<R()>(f));
+        std::future<R> result = task->get_future();
+
+        run([task]() { (*task)(); });
+
+        return result;
+    }
+
+    /** Get the number of hardware threads
+    * @return the number of threads, at least 1
+    */
+    /****************************************************************/
+    static int hardwareThreads();
+};
+
+}
+
+#endif
@@ -24,6 +24,9 @@
 #define SUPERQTREE_H
 
 #include <Eigen/Dense>
+#include <Eigen/StdDeque>
+#include <deque>
+#include <mutex>
 
 #include <SuperquadricLibModel/superquadric.h>
 #include <SuperquadricLibModel/pointCloud.h>
@@ -32,20 +35,34 @@ namespace SuperqModel {
 
 struct node
 {
-    int height;
+    SuperqModel::Superquadric superq;
+    Eigen::Vector4d plane;
+    SuperqModel::PointCloud *point_cloud;
+
     node *left;
     node *right;
     node *father;
     node *uncle_close;
 
-    SuperqModel::PointCloud *point_cloud;
-    SuperqModel::Superquadric superq;
-    Eigen::Vector4d plane;
-    Eigen::Vector3d axis_x;
-    Eigen::Vector3d axis_y;
-    Eigen::Vector3d axis_z;
-    Eigen::Matrix3d R;
+    // Normalized residual of the superquadric, 0 if it is not fitted to the points of the node
+    double residual;
+
+    int height;
     bool plane_important;
+    // True if the plane of this node or of a node below it is important
+    bool important_below;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    /** Get an axis of the superquadric, computed from its current orientation
+    * @param i is the index of the axis (0 for x, 1 for y, 2 for z)
+    * @return the axis
+    */
+    /***********************************************************************/
+    inline Eigen::Vector3d axis(const int &i) const
+    {
+        return superq.getSuperqAxes().col(i);
+    }
 };
 
 struct nodeContent
@@ -57,10 +74,41 @@ struct nodeContent
     bool plane_important;
 };
 
+/**
+* \class SuperqModel::SuperqTree
+* \headerfile tree.h <SuperquadricModel/include/tree.h>
+*
+* \brief A class from SuperqModel namespace.
+*
+* This class is the tree of the superquadrics fitted on the splits of a point cloud.
+* The nodes and the point clouds of the nodes are allocated in arenas owned by the
+* tree, whose addresses do not change when they grow, and are all released at
+* once by reset or by the destructor, also when they are not linked to the root.
+* The allocations and the changes of the links and of the important_below flags are
+* serialized by a mutex, so that the subtrees can be grown by concurrent threads.
+*/
 class SuperqTree
 {
+    std::deque<node, Eigen::aligned_allocator<node>> nodes;
+    std::deque<SuperqModel::PointCloud, Eigen::aligned_allocator<SuperqModel::PointCloud>> point_clouds;
+    // Guards the arenas and the flags updated up to the shared ancestors
+    mutable std::mutex mutex;
+
+    SuperqTree(const SuperqTree &) = delete;
+    SuperqTree &operator=(const SuperqTree &) = delete;
+
+    /** Allocate a node in the arena, with the mutex locked
+    * @return the node, without children
+    */
     /***********************************************************************/
-    void destroy_tree(node *leaf);
+    node *newNode();
+
+    /** Update the important_below flags of a node and of its ancestors,
+    * stopping at the first one that does not change, with the mutex locked
+    * @param leaf is the node
+    */
+    /***********************************************************************/
+    void updateImportantBelow(node *leaf);
 
 public:
 
@@ -75,9 +123,16 @@ public:
     /***********************************************************************/
     ~SuperqTree();
 
+    /** Release all the nodes and the point clouds, the tree is left with an empty root */
     /***********************************************************************/
     void destroy_tree();
 
+    /** Allocate a point cloud for a node
+    * @return the point cloud, valid until the tree is reset or destroyed
+    */
+    /***********************************************************************/
+    SuperqModel::PointCloud *newPointCloud();
+
     /***********************************************************************/
     void printNode(node *leaf);
 
@@ -93,8 +148,31 @@ public:
     /***********************************************************************/
     void reset();
 
+    /** Set if the plane of a node is important, updating the flags of its ancestors
+    * @param leaf is the node
+    * @param important is true if the plane is important
+    */
+    /***********************************************************************/
+    void setPlaneImportant(node *leaf, const bool &important);
+
+    /** Detach the children of a node, they stay allocated until the tree is reset
+    * @param leaf is the node
+    */
+    /***********************************************************************/
+    void removeChildren(node *leaf);
+
+    /** Check if a subtree has an important plane, in constant time
+    * @param leaf is the root of the subtree
+    * @return true if the plane of leaf or of a node below it is important
+    */
+    /***********************************************************************/
+    bool searchPlaneImportant(const node *leaf) const;
+
+    /** Get the number of nodes allocated since the last reset
+    * @return the number of nodes, root included
+    */
     /***********************************************************************/
-    bool searchPlaneImportant(const node *leaf);
+    int getNumberNodes() const;
 };
 
 }
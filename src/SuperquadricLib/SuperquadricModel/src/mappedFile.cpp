@@ -0,0 +1,144 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+
+/**
+ * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+ */
+
+#include <SuperquadricLibModel/mappedFile.h>
+
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace SuperqModel;
+
+/*********************************************/
+MappedFile::MappedFile() : data(nullptr), length(0), mapped(false)
+{
+}
+
+/*********************************************/
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+/*********************************************/
+bool MappedFile::open(const string &file_name)
+{
+    close();
+
+#ifndef _WIN32
+    int fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    length = (size_t)info.st_size;
+    if (length > 0)
+    {
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        // The pages are loaded at once instead of on the first access
+        flags |= MAP_POPULATE;
+#endif
+        void *p = mmap(nullptr, length, PROT_READ, flags, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            ::close(fd);
+            length = 0;
+            return false;
+        }
+
+        data = static_cast<const char*>(p);
+        mapped = true;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+
+    return true;
+#else
+    ifstream fin(file_name, ios::binary | ios::ate);
+    if (!fin.is_open())
+        return false;
+
+    streamoff n = fin.tellg();
+    if (n < 0)
+        return false;
+
+    buffer.resize((size_t)n);
+    fin.seekg(0);
+    if (n > 0 && !fin.read(buffer.data(), n))
+    {
+        buffer.clear();
+        return false;
+    }
+
+    length = buffer.size();
+    data = (length > 0 ? buffer.data() : nullptr);
+
+    return true;
+#endif
+}
+
+/*********************************************/
+void MappedFile::close()
+{
+#ifndef _WIN32
+    if (mapped)
+        munmap(const_cast<char*>(data), length);
+#endif
+
+    buffer.clear();
+    buffer.shrink_to_fit();
+    data = nullptr;
+    length = 0;
+    mapped = false;
+}
+
+/*********************************************/
+const char *MappedFile::begin() const
+{
+    return data;
+}
+
+/*********************************************/
+const char *MappedFile::end() const
+{
+    return data + length;
+}
+
+/*********************************************/
+size_t MappedFile::size() const
+{
+    return length;
+}
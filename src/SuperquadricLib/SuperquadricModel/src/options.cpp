@@ -20,9 +20,12 @@
   * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
   */
 
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 
 #include <SuperquadricLibModel/options.h>
+#include <SuperquadricLibModel/pointSampler.h>
 
 using namespace std;
 
@@ -35,10 +38,18 @@ Options::Options()
     pars.mu_strategy = "adaptive";
     pars.nlp_scaling_method = "gradient-based";
     pars.hessian_approximation = "limited-memory";
+    pars.derivative_test = "none";
     pars.print_level = 0;
     pars.object_class = "default";
     pars.optimizer_points = 50;
     pars.random_sampling = true;
+    pars.sampling_method = "random";
+    pars.solver = "ipopt";
+    pars.tracking_threshold = 10.0;
+    pars.warm_start = false;
+    pars.object_classes = {"default", "box", "cylinder", "sphere"};
+    pars.class_win_residual = 1e-4;
+    pars.n_threads = 0;
 }
 
 /****************************************************************/
@@ -71,6 +82,24 @@ bool Options::SetNumericValue(const string &tag, const double &value)
 
         return true;
     }
+    else if (tag == "tracking_threshold")
+    {
+        pars.tracking_threshold = value;
+        cout << "|| ---------------------------------------------------- ||" << endl;
+        cout << "|| Tracking threshold set                               : " << pars.tracking_threshold <<endl;
+        cout << "|| ---------------------------------------------------- ||" << endl << endl;
+
+        return true;
+    }
+    else if (tag == "class_win_residual")
+    {
+        pars.class_win_residual = value;
+        cout << "|| ---------------------------------------------------- ||" << endl;
+        cout << "|| Class win residual set                               : " << pars.class_win_residual <<endl;
+        cout << "|| ---------------------------------------------------- ||" << endl << endl;
+
+        return true;
+    }
     // Multiple superquadric estimation
     else if (tag == "threshold_axis")
     {
@@ -99,6 +128,15 @@ bool Options::SetNumericValue(const string &tag, const double &value)
 
         return true;
     }
+    else if (tag == "split_residual")
+    {
+        m_pars.split_residual = value;
+        cout << "|| ---------------------------------------------------- ||" << endl;
+        cout << "|| Split residual set                                   : " << m_pars.split_residual <<endl;
+        cout << "|| ---------------------------------------------------- ||" << endl << endl;
+
+        return true;
+    }
     else
     {
         cout << "|| ---------------------------------------------------- ||" << endl;
@@ -148,6 +186,15 @@ bool Options::SetIntegerValue(const string &tag, const int &value)
 
         return true;
     }
+    else if (tag == "n_threads")
+    {
+        pars.n_threads = value;
+        cout << "|| ---------------------------------------------------- ||" << endl;
+        cout << "|| Number of threads set                                : " << pars.n_threads <<endl;
+        cout << "|| ---------------------------------------------------- ||" << endl << endl;
+
+        return true;
+    }
     // Multiple superquadric estimation
     else if (tag == "minimum_points")
     {
@@ -190,6 +237,7 @@ bool Options::SetBoolValue(const string &tag, const bool &value)
     if (tag == "random_sampling")
     {
         pars.random_sampling = value;
+        pars.sampling_method = (value ? "random" : "stride");
         cout << "|| ---------------------------------------------------- ||" << endl;
         cout << "|| Random sampling set                                  : " << pars.random_sampling <<endl;
         cout << "|| ---------------------------------------------------- ||" << endl << endl;
@@ -205,6 +253,33 @@ bool Options::SetBoolValue(const string &tag, const bool &value)
 
         return true;
     }
+    else if (tag == "parallel_modeling")
+    {
+        m_pars.parallel_modeling = value;
+        cout << "|| ---------------------------------------------------- ||" << endl;
+        cout << "|| Parallel modeling set                                : " << m_pars.parallel_modeling <<endl;
+        cout << "|| ---------------------------------------------------- ||" << endl << endl;
+
+        return true;
+    }
+    else if (tag == "adaptive_splitting")
+    {
+        m_pars.adaptive_splitting = value;
+        cout << "|| ---------------------------------------------------- ||" << endl;
+        cout << "|| Adaptive splitting set                               : " << m_pars.adaptive_splitting <<endl;
+        cout << "|| ---------------------------------------------------- ||" << endl << endl;
+
+        return true;
+    }
+    else if (tag == "parent_initial_guess")
+    {
+        m_pars.parent_initial_guess = value;
+        cout << "|| ---------------------------------------------------- ||" << endl;
+        cout << "|| Parent initial guess set                             : " << m_pars.parent_initial_guess <<endl;
+        cout << "|| ---------------------------------------------------- ||" << endl << endl;
+
+        return true;
+    }
     else
     {
         cout << "|| ---------------------------------------------------- ||" << endl;
@@ -234,7 +309,7 @@ bool Options::SetStringValue(const string &tag, const string &value)
 
         return true;
     }
-    else if (tag == "print_lehessian_approximationvel")
+    else if (tag == "hessian_approximation")
     {
         pars.hessian_approximation = value;
         cout << "|| ---------------------------------------------------- ||" << endl;
@@ -243,6 +318,15 @@ bool Options::SetStringValue(const string &tag, const string &value)
 
         return true;
     }
+    else if (tag == "derivative_test")
+    {
+        pars.derivative_test = value;
+        cout << "|| ---------------------------------------------------- ||" << endl;
+        cout << "|| Derivative test set                                  : " << pars.derivative_test <<endl;
+        cout << "|| ---------------------------------------------------- ||" << endl << endl;
+
+        return true;
+    }
     // Superquadric estimation
     else if (tag == "object_class")
     {
@@ -253,6 +337,72 @@ bool Options::SetStringValue(const string &tag, const string &value)
 
         return true;
     }
+    else if (tag == "object_classes")
+    {
+        // Classes are separated by commas or spaces
+        string list = value;
+        replace(list.begin(), list.end(), ',', ' ');
+        istringstream iss(list);
+        vector<string> classes;
+        string c;
+        while (iss >> c)
+        {
+            if (c != "default" && c != "box" && c != "cylinder" && c != "sphere")
+            {
+                cout << "|| ---------------------------------------------------- ||" << endl;
+                cout << "|| Not valid object class (default, box, cylinder or sphere)!" << endl << endl;
+                return false;
+            }
+            classes.push_back(c);
+        }
+
+        if (classes.empty())
+        {
+            cout << "|| ---------------------------------------------------- ||" << endl;
+            cout << "|| No object class given!                                 " << endl << endl;
+            return false;
+        }
+
+        pars.object_classes = classes;
+        cout << "|| ---------------------------------------------------- ||" << endl;
+        cout << "|| Object classes set                                   : " << list <<endl;
+        cout << "|| ---------------------------------------------------- ||" << endl << endl;
+
+        return true;
+    }
+    else if (tag == "sampling_method")
+    {
+        if (!SuperqModel::PointSampler::isValid(value))
+        {
+            cout << "|| ---------------------------------------------------- ||" << endl;
+            cout << "|| Not valid sampling method, see PointSampler!" << endl << endl;
+            return false;
+        }
+
+        pars.sampling_method = value;
+        pars.random_sampling = (value != "stride");
+        cout << "|| ---------------------------------------------------- ||" << endl;
+        cout << "|| Sampling method set                                  : " << pars.sampling_method <<endl;
+        cout << "|| ---------------------------------------------------- ||" << endl << endl;
+
+        return true;
+    }
+    else if (tag == "solver")
+    {
+        if (value != "ipopt" && value != "levenberg-marquardt")
+        {
+            cout << "|| ---------------------------------------------------- ||" << endl;
+            cout << "|| Not valid solver (ipopt or levenberg-marquardt)!      " << endl << endl;
+            return false;
+        }
+
+        pars.solver = value;
+        cout << "|| ---------------------------------------------------- ||" << endl;
+        cout << "|| Solver set                                           : " << pars.solver <<endl;
+        cout << "|| ---------------------------------------------------- ||" << endl << endl;
+
+        return true;
+    }
     // Grasp commputation
     else if (tag == "left_or_right")
     {
@@ -21,20 +21,371 @@
   */
 
 #include <SuperquadricLibModel/pointCloud.h>
-#include <boost/range/irange.hpp>
-
-#include <iostream>
+#include <SuperquadricLibModel/pointSampler.h>
+#include <SuperquadricLibModel/mappedFile.h>
+#include <SuperquadricLibModel/spatialIndex.h>
+#include <SuperquadricLibModel/threadPool.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
-#include <set>
-#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <locale>
+#include <sstream>
 
 using namespace std;
-using namespace boost;
 using namespace Eigen;
 using namespace SuperqModel;
 
+namespace {
+
+// Text files smaller than two chunks are parsed by the calling thread
+const size_t min_chunk_size = 1 << 20;
+const size_t chunks_per_thread = 4;
+
+// Header of the binary files, followed by the coordinates and the colors
+struct BinaryHeader
+{
+    char magic[4];
+    uint32_t byte_order;
+    uint32_t version;
+    uint32_t scalar_size;
+    uint64_t count;
+    uint64_t stride;
+    uint64_t points_offset;
+    uint64_t colors_offset;
+};
+
+const char binary_magic[4] = {'S', 'Q', 'P', 'C'};
+const uint32_t binary_byte_order = 0x01020304;
+const uint32_t binary_version = 1;
+// The coordinates start at a multiple of the size of a cache line
+const uint64_t binary_points_offset = 64;
+
+// Powers of 10 exactly representable as double
+const double exact_powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                               1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+/*********************************************/
+inline bool isBlank(const char &c)
+{
+    return (c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f');
+}
+
+/*********************************************/
+inline bool isDigit(const char &c)
+{
+    return (c >= '0' && c <= '9');
+}
+
+/*********************************************/
+bool parseDouble(const char *&p, const char *end, double &value)
+{
+    while (p < end && isBlank(*p))
+        p++;
+
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    bool digits = false, exact = true;
+    for (; p < end && isDigit(*p); p++)
+    {
+        digits = true;
+        if (mantissa < 100000000000000000ULL)
+            mantissa = 10*mantissa + (*p - '0');
+        else
+        {
+            exponent++;
+            exact = false;
+        }
+    }
+
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && isDigit(*p); p++)
+        {
+            digits = true;
+            if (mantissa < 100000000000000000ULL)
+            {
+                mantissa = 10*mantissa + (*p - '0');
+                exponent--;
+            }
+            else
+                exact = false;
+        }
+    }
+
+    if (!digits)
+    {
+        p = start;
+        return false;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        bool negative_exp = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negative_exp = (*q++ == '-');
+
+        if (q < end && isDigit(*q))
+        {
+            int e = 0;
+            for (; q < end && isDigit(*q); q++)
+                e = min(10*e + (*q - '0'), 100000);
+
+            exponent += (negative_exp ? -e : e);
+            p = q;
+        }
+    }
+
+    // The result is correctly rounded if both the mantissa and the power of 10
+    // are exact doubles, otherwise the standard parser is used
+    if (exact && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+    {
+        value = (double)mantissa;
+        value = (exponent < 0 ? value/exact_powers[-exponent] : value*exact_powers[exponent]);
+    }
+    else
+    {
+        istringstream iss(string(start, p));
+        iss.imbue(locale::classic());
+        if (!(iss >> value))
+            return false;
+        return true;
+    }
+
+    if (negative)
+        value = -value;
+
+    return true;
+}
+
+/*********************************************/
+bool parseUnsigned(const char *&p, const char *end, unsigned int &value)
+{
+    while (p < end && isBlank(*p))
+        p++;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+
+    if (p == end || !isDigit(*p))
+        return false;
+
+    unsigned long long v = 0;
+    for (; p < end && isDigit(*p); p++)
+    {
+        v = 10*v + (*p - '0');
+        if (v > numeric_limits<unsigned int>::max())
+        {
+            value = numeric_limits<unsigned int>::max();
+            return false;
+        }
+    }
+
+    value = (negative ? 0u - (unsigned int)v : (unsigned int)v);
+
+    return true;
+}
+
+/*********************************************/
+bool parseLine(const char *&p, const char *end, Vector3d &point, unsigned char *color)
+{
+    if (!parseDouble(p, end, point(0)) || !parseDouble(p, end, point(1)) || !parseDouble(p, end, point(2)))
+        return false;
+
+    // Missing color channels are gray
+    unsigned int c[3] = {120, 120, 120};
+    for (int i = 0; i < 3; i++)
+    {
+        if (!parseUnsigned(p, end, c[i]))
+            break;
+    }
+
+    color[0] = (unsigned char)c[0];
+    color[1] = (unsigned char)c[1];
+    color[2] = (unsigned char)c[2];
+
+    if (color[0] == color[1] && color[1] == color[2])
+    {
+        color[0] = 50;
+        color[1] = 100;
+        color[2] = 0;
+    }
+
+    return true;
+}
+
+}
+
+/*********************************************/
+PointStore::PointStore() : data(nullptr), stride(0), single_precision(false), n(0)
+{
+}
+
+/*********************************************/
+PointStore::PointStore(const deque<Vector3d> &p) : data(nullptr), stride(0), single_precision(false), n(p.size())
+{
+    owned.assign(p.begin(), p.end());
+}
+
 /*********************************************/
-PointCloud::PointCloud()
+PointStore::PointStore(vector<Vector3d, aligned_allocator<Vector3d>> &&p) : data(nullptr), stride(0), single_precision(false), n(p.size())
+{
+    owned.swap(p);
+}
+
+/*********************************************/
+PointStore::PointStore(const double *buffer, const int &num, const size_t &stride_bytes, const shared_ptr<const void> &buffer_owner) :
+    data(reinterpret_cast<const unsigned char*>(buffer)), stride(stride_bytes), single_precision(false), n(num), owner(buffer_owner)
+{
+}
+
+/*********************************************/
+PointStore::PointStore(const float *buffer, const int &num, const size_t &stride_bytes, const shared_ptr<const void> &buffer_owner) :
+    data(reinterpret_cast<const unsigned char*>(buffer)), stride(stride_bytes), single_precision(true), n(num), owner(buffer_owner)
+{
+}
+
+/*********************************************/
+int PointStore::size() const
+{
+    return n;
+}
+
+/*********************************************/
+bool PointStore::isView() const
+{
+    return (data != nullptr);
+}
+
+/*********************************************/
+PointColors::PointColors() : rgb(nullptr), n(0)
+{
+}
+
+/*********************************************/
+PointColors::PointColors(vector<unsigned char> &&packed) : rgb(nullptr), n(packed.size()/3)
+{
+    if (n > 0)
+    {
+        shared_ptr<vector<unsigned char>> buffer = make_shared<vector<unsigned char>>();
+        buffer->swap(packed);
+        rgb = buffer->data();
+        owner = buffer;
+    }
+}
+
+/*********************************************/
+PointColors::PointColors(const unsigned char *buffer, const int &num, const shared_ptr<const void> &buffer_owner) :
+    owner(buffer_owner), rgb(buffer), n(num)
+{
+}
+
+/*********************************************/
+int PointColors::size() const
+{
+    return n;
+}
+
+/*********************************************/
+bool PointColors::empty() const
+{
+    return (n == 0);
+}
+
+/*********************************************/
+void PointColors::clear()
+{
+    owner.reset();
+    rgb = nullptr;
+    n = 0;
+}
+
+/*********************************************/
+const unsigned char *PointColors::data() const
+{
+    return rgb;
+}
+
+/*********************************************/
+const shared_ptr<const void> &PointColors::getOwner() const
+{
+    return owner;
+}
+
+/*********************************************/
+PointCloudStats::PointCloudStats() : count(0)
+{
+    sum.setZero();
+    moments.setZero();
+    lower.setConstant(numeric_limits<double>::infinity());
+    upper.setConstant(-numeric_limits<double>::infinity());
+}
+
+/*********************************************/
+void PointCloudStats::merge(const PointCloudStats &other)
+{
+    count += other.count;
+    sum += other.sum;
+    moments += other.moments;
+    lower = lower.cwiseMin(other.lower);
+    upper = upper.cwiseMax(other.upper);
+}
+
+/*********************************************/
+Vector3d PointCloudStats::getMean() const
+{
+    return sum/count;
+}
+
+/*********************************************/
+Matrix32d PointCloudStats::getBoundingBox() const
+{
+    Matrix32d bounding_box;
+    bounding_box.col(0) = lower;
+    bounding_box.col(1) = upper;
+
+    return bounding_box;
+}
+
+/*********************************************/
+Vector3d PointCloudStats::getCenter() const
+{
+    return (lower + upper)/2;
+}
+
+/*********************************************/
+Matrix3d PointCloudStats::getCovariance(const Vector3d &center) const
+{
+    // sum((p - c)*(p - c)^T) = sum(p*p^T) - c*s^T - s*c^T + n*c*c^T
+    Matrix3d M = moments.selfadjointView<Upper>();
+    M -= center*sum.transpose() + sum*center.transpose();
+    M += count*center*center.transpose();
+
+    return M/count;
+}
+
+/*********************************************/
+Matrix3d PointCloudStats::getAxes() const
+{
+    Matrix3d M = getCovariance(getCenter());
+
+    JacobiSVD<MatrixXd> svd(M, ComputeFullU | ComputeFullU);
+    return svd.matrixU();
+}
+
+/*********************************************/
+PointCloud::PointCloud() : store(make_shared<PointStore>()), vis_offset(0), vis_count(0), vis_range_owned(false),
+                           spatial_cache(make_shared<SpatialCache>())
 {
     n_points=0;
 }
@@ -42,7 +393,6 @@ PointCloud::PointCloud()
 /*********************************************/
 PointCloud::~PointCloud()
 {
-    points.clear();
     n_points=0;
 }
 
@@ -54,13 +404,9 @@ bool PointCloud::setPoints(const deque<Vector3d> &p)
         if (p[0].size() == 3)
         {
             deletePoints();
-            for (auto& point : p)
-            {
-                points.push_back(point);
-                points_for_vis.push_back(point);
-            }
+            store = make_shared<PointStore>(p);
 
-            n_points = points.size();
+            n_points = store->size();
 
             return true;
         }
@@ -71,6 +417,67 @@ bool PointCloud::setPoints(const deque<Vector3d> &p)
     return false;
 }
 
+/*********************************************/
+bool PointCloud::setPoints(const double *buffer, const int &num, const size_t &stride_bytes)
+{
+    if (buffer == nullptr || num <= 0 || stride_bytes < 3*sizeof(double))
+        return false;
+
+    deletePoints();
+    store = make_shared<PointStore>(buffer, num, stride_bytes);
+
+    n_points = store->size();
+
+    return true;
+}
+
+/*********************************************/
+bool PointCloud::setPoints(const float *buffer, const int &num, const size_t &stride_bytes)
+{
+    if (buffer == nullptr || num <= 0 || stride_bytes < 3*sizeof(float))
+        return false;
+
+    deletePoints();
+    store = make_shared<PointStore>(buffer, num, stride_bytes);
+
+    n_points = store->size();
+
+    return true;
+}
+
+/*********************************************/
+bool PointCloud::setPoints(const PointCloud &source, const vector<int> &indices)
+{
+    if (indices.size() == 0)
+        return false;
+
+    shared_ptr<vector<int>> idx = make_shared<vector<int>>(indices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+        (*idx)[i] = source.storeIndex(indices[i]);
+
+    // The source may be this point cloud
+    shared_ptr<const PointStore> source_store = source.store;
+    deletePoints();
+    store = source_store;
+    vis_indices = idx;
+    vis_count = idx->size();
+
+    n_points = vis_count;
+
+    return true;
+}
+
+/*********************************************/
+bool PointCloud::setPoints(const PointCloud &source, const vector<int> &indices, const PointCloudStats &stats)
+{
+    if (!setPoints(source, indices))
+        return false;
+
+    vis_stats = make_shared<PointCloudStats>(stats);
+
+    return true;
+}
+
 /*********************************************/
 bool PointCloud::setColors(const vector<vector<unsigned char>> &c)
 {
@@ -79,16 +486,11 @@ bool PointCloud::setColors(const vector<vector<unsigned char>> &c)
     {
         if (c[0].size() == 3)
         {
-            for (auto& color:c)
-            {
-                colors.push_back(color);
-            }
-
-            if (colors.size() == n_points)
-              return true;
-            else
-              return false;
+            vector<unsigned char> rgb(3*c.size(), 0);
+            for (size_t i = 0; i < c.size(); i++)
+                copy(c[i].begin(), c[i].begin() + min(c[i].size(), (size_t)3), rgb.begin() + 3*i);
 
+            return setColors(move(rgb));
         }
         else
             return false;
@@ -98,45 +500,194 @@ bool PointCloud::setColors(const vector<vector<unsigned char>> &c)
 }
 
 /*********************************************/
-int PointCloud::getNumberPoints()
+bool PointCloud::setColors(vector<unsigned char> &&rgb)
+{
+    colors = PointColors(move(rgb));
+
+    if (colors.size() == n_points)
+      return true;
+    else
+      return false;
+}
+
+/*********************************************/
+int PointCloud::getNumberPoints() const
 {
     return n_points;
 }
 
+/*********************************************/
+vector<Vector3d, aligned_allocator<Vector3d>> PointCloud::getPoints() const
+{
+    vector<Vector3d, aligned_allocator<Vector3d>> p(n_points);
+    for (int i = 0; i < n_points; i++)
+        p[i] = getPoint(i);
+
+    return p;
+}
+
+/*********************************************/
+int PointCloud::getNumberPointsForVis() const
+{
+    return (vis_indices ? vis_count : store->size());
+}
+
+/*********************************************/
+vector<Vector3d, aligned_allocator<Vector3d>> PointCloud::getPointsForVis() const
+{
+    int n = getNumberPointsForVis();
+    vector<Vector3d, aligned_allocator<Vector3d>> p(n);
+    for (int i = 0; i < n; i++)
+        p[i] = getPointForVis(i);
+
+    return p;
+}
+
 /*********************************************/
 void PointCloud::deletePoints()
 {
-    points.clear();
-    points_for_vis.clear();
+    store = make_shared<PointStore>();
+    vis_indices.reset();
+    vis_offset = 0;
+    vis_count = 0;
+    vis_range_owned = false;
+    sample_indices.reset();
+    vis_stats.reset();
+    spatial_cache = make_shared<SpatialCache>();
+    n_points = 0;
 }
 
 /*********************************************/
-MatrixXd PointCloud::getBoundingBox()
+PointCloudStats PointCloud::getStats() const
 {
-  bounding_box(0,0) = numeric_limits<double>::infinity();
-  bounding_box(1,0) = numeric_limits<double>::infinity();
-  bounding_box(2,0) = numeric_limits<double>::infinity();
-  bounding_box(0,1) = -numeric_limits<double>::infinity();
-  bounding_box(1,1) = -numeric_limits<double>::infinity();
-  bounding_box(2,1) = -numeric_limits<double>::infinity();
+    // The samplers keep all the points if they are no more than desired
+    if (vis_stats && n_points == getNumberPointsForVis())
+        return *vis_stats;
 
-  for (auto& point : points)
-  {
-      if (bounding_box(0,0) > point(0))
-          bounding_box(0,0) = point(0);
-      if (bounding_box(0,1) < point(0))
-          bounding_box(0,1) = point(0);
-
-      if (bounding_box(1,0) > point(1))
-          bounding_box(1,0) = point(1);
-      if (bounding_box(1,1) < point(1))
-          bounding_box(1,1) = point(1);
-
-      if (bounding_box(2,0) > point(2))
-          bounding_box(2,0) = point(2);
-      if (bounding_box(2,1) < point(2))
-          bounding_box(2,1) = point(2);
-  }
+    PointCloudStats stats;
+    for (int i = 0; i < n_points; i++)
+        stats.add(getPoint(i));
+
+    return stats;
+}
+
+/*********************************************/
+PointCloudStats PointCloud::getStatsForVis() const
+{
+    if (vis_stats)
+        return *vis_stats;
+
+    PointCloudStats stats;
+    int n = getNumberPointsForVis();
+    for (int i = 0; i < n; i++)
+        stats.add(getPointForVis(i));
+
+    return stats;
+}
+
+/*********************************************/
+void PointCloud::splitByPlane(const Vector4d &plane, PointCloud &above, PointCloud &below)
+{
+    splitByPlane(plane, above, below, false);
+}
+
+/*********************************************/
+void PointCloud::splitByPlane(const Vector4d &plane, PointCloud &above, PointCloud &below, const bool &in_place)
+{
+    int n = getNumberPointsForVis();
+
+    // The range of a view made by splitByPlane is partitioned in place if
+    // requested, otherwise the indices are copied once in a new array
+    shared_ptr<vector<int>> indices;
+    int offset = 0;
+    bool reorder = (in_place && vis_range_owned && !sample_indices);
+    if (reorder)
+    {
+        indices = vis_indices;
+        offset = vis_offset;
+    }
+    else
+    {
+        indices = make_shared<vector<int>>(n);
+        for (int i = 0; i < n; i++)
+            (*indices)[i] = storeIndex(i);
+    }
+
+    // The points above are compacted at the beginning of the range, the ones
+    // below are appended after them
+    vector<int> indices_below;
+    PointCloudStats stats_above, stats_below;
+    int n_above = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int s = (*indices)[offset + i];
+        Vector3d point = store->point(s);
+        if (plane(0)*point(0)+plane(1)*point(1)+plane(2)*point(2) - plane(3) > 0)
+        {
+            (*indices)[offset + n_above++] = s;
+            stats_above.add(point);
+        }
+        else
+        {
+            indices_below.push_back(s);
+            stats_below.add(point);
+        }
+    }
+    copy(indices_below.begin(), indices_below.end(), indices->begin() + offset + n_above);
+
+    // The indices of the spatial indices of this point cloud have changed
+    if (reorder)
+    {
+        lock_guard<mutex> lock(spatial_cache->mutex);
+        spatial_cache->kd_tree.reset();
+        spatial_cache->voxel_hash.reset();
+    }
+
+    shared_ptr<const PointStore> source_store = store;
+    PointCloud *sides[2] = {&above, &below};
+    const PointCloudStats *stats[2] = {&stats_above, &stats_below};
+    int begin[2] = {offset, offset + n_above};
+    int count[2] = {n_above, n - n_above};
+    for (int k = 0; k < 2; k++)
+    {
+        sides[k]->deletePoints();
+        sides[k]->store = source_store;
+        sides[k]->vis_indices = indices;
+        sides[k]->vis_offset = begin[k];
+        sides[k]->vis_count = count[k];
+        sides[k]->vis_range_owned = true;
+        sides[k]->vis_stats = make_shared<PointCloudStats>(*stats[k]);
+        sides[k]->n_points = count[k];
+    }
+}
+
+/*********************************************/
+shared_ptr<const KdTree> PointCloud::getKdTree(const int &n_threads) const
+{
+    lock_guard<mutex> lock(spatial_cache->mutex);
+    if (!spatial_cache->kd_tree)
+        spatial_cache->kd_tree = make_shared<KdTree>(getPointsForVis(), n_threads);
+
+    return spatial_cache->kd_tree;
+}
+
+/*********************************************/
+shared_ptr<const VoxelHash> PointCloud::getVoxelHash(const double &cell_size) const
+{
+    lock_guard<mutex> lock(spatial_cache->mutex);
+    if (!spatial_cache->voxel_hash || spatial_cache->voxel_cell_size != cell_size)
+    {
+        spatial_cache->voxel_hash = make_shared<VoxelHash>(getPointsForVis(), cell_size);
+        spatial_cache->voxel_cell_size = cell_size;
+    }
+
+    return spatial_cache->voxel_hash;
+}
+
+/*********************************************/
+MatrixXd PointCloud::getBoundingBox()
+{
+  bounding_box = getStats().getBoundingBox();
 
   return bounding_box;
 }
@@ -151,9 +702,9 @@ MatrixXd PointCloud::getBoundingBoxSuperqFrame(const Matrix3d &orientation)
   bounding_box(1,1) = -numeric_limits<double>::infinity();
   bounding_box(2,1) = -numeric_limits<double>::infinity();
 
-  for (auto& point : points)
+  for (int i = 0; i < n_points; i++)
   {
-      Vector3d point_tmp = orientation.transpose() * point;
+      Vector3d point_tmp = orientation.transpose() * getPoint(i);
       if (bounding_box(0,0) > point_tmp(0))
           bounding_box(0,0) = point_tmp(0);
       if (bounding_box(0,1) < point_tmp(0))
@@ -177,11 +728,7 @@ MatrixXd PointCloud::getBoundingBoxSuperqFrame(const Matrix3d &orientation)
 Vector3d PointCloud::getBarycenter()
 {
     bounding_box = getBoundingBox();
-
-    barycenter.resize(3);
-    barycenter(0) = (bounding_box(0,0)+bounding_box(0,1))/2;
-    barycenter(1) = (bounding_box(1,0)+bounding_box(1,1))/2;
-    barycenter(2) = (bounding_box(2,0)+bounding_box(2,1))/2;
+    barycenter = (bounding_box.col(0) + bounding_box.col(1))/2;
 
     return barycenter;
 }
@@ -189,194 +736,268 @@ Vector3d PointCloud::getBarycenter()
 /*********************************************/
 Matrix3d PointCloud::getAxes()
 {
-    Matrix3d M;
-    M.setZero();
-    barycenter.setZero();
-    barycenter = getBarycenter();
+    PointCloudStats stats = getStats();
+
+    bounding_box = stats.getBoundingBox();
+    barycenter = stats.getCenter();
+    orientation = stats.getAxes();
+
+    return orientation;
+}
+
+/*********************************************/
+void PointCloud::subSample(const int &desired_points, const bool &random)
+{
+    subSample(desired_points, string(random ? "random" : "stride"));
+}
 
-    for (auto& point: points)
+/*********************************************/
+bool PointCloud::subSample(const int &desired_points, const string &method)
+{
+    unique_ptr<PointSampler> sampler(PointSampler::create(method));
+    if (!sampler)
     {
-        double x = point(0) - barycenter(0);
-        double y = point(1) - barycenter(1);
-        double z = point(2) - barycenter(2);
+        cerr << "Unknown sampling method \"" << method << "\""<<endl;
+        return false;
+    }
 
-        M(0,0) += x*x;
-        M(0,1) += x*y;
-        M(0,2) += x*z;
-        M(1,1) += y*y;
-        M(2,2) += z*z;
-        M(1,2) += y*z;
+    // Only the indices of the selected points are stored, among the points for vis
+    shared_ptr<vector<int>> idx = make_shared<vector<int>>();
+    sampler->sample(*this, desired_points, *idx);
+
+    // Indices of an already downsampled point cloud are mapped to the points for vis
+    if (sample_indices)
+    {
+        for (auto &i : *idx)
+            i = (*sample_indices)[i];
     }
 
-    M(0,0) = M(0,0)/points.size();
-    M(0,1) = M(0,1)/points.size();
-    M(0,2) = M(0,2)/points.size();
-    M(1,1) = M(1,1)/points.size();
-    M(2,2) = M(2,2)/points.size();
-    M(1,2) = M(1,2)/points.size();
+    sample_indices = idx;
 
-    M(1,0) = M(0,1);
-    M(2,0) = M(0,2);
-    M(2,1) = M(1,2);
+    n_points = idx->size();
 
-    JacobiSVD<MatrixXd> svd(M, ComputeFullU | ComputeFullU);
-    orientation = svd.matrixU();
+    return true;
+}
 
-    return orientation;
+/*********************************************/
+bool PointCloud::setPointsFromBinary(const shared_ptr<const MappedFile> &file)
+{
+    BinaryHeader header;
+    if (file->size() < sizeof(header))
+        return false;
+    memcpy(&header, file->begin(), sizeof(header));
+
+    if (header.byte_order != binary_byte_order || header.version != binary_version ||
+        (header.scalar_size != sizeof(float) && header.scalar_size != sizeof(double)) ||
+        header.stride < 3*header.scalar_size || header.count == 0 ||
+        header.count > (uint64_t)numeric_limits<int>::max())
+        return false;
+
+    // The arrays have to be within the file
+    uint64_t size = file->size();
+    if (header.points_offset > size || (size - header.points_offset)/header.stride < header.count)
+        return false;
+    if (header.colors_offset != 0 && (header.colors_offset > size || (size - header.colors_offset)/3 < header.count))
+        return false;
+
+    int num = (int)header.count;
+    const char *points = file->begin() + header.points_offset;
+
+    deletePoints();
+    if (header.scalar_size == sizeof(float))
+        store = make_shared<PointStore>(reinterpret_cast<const float*>(points), num, header.stride, file);
+    else
+        store = make_shared<PointStore>(reinterpret_cast<const double*>(points), num, header.stride, file);
+
+    n_points = store->size();
+
+    // The colors are a view of the file too
+    colors.clear();
+    if (header.colors_offset != 0)
+        colors = PointColors(reinterpret_cast<const unsigned char*>(file->begin() + header.colors_offset), num, file);
+
+    return true;
 }
 
 /*********************************************/
-void PointCloud::subSample(const int &desired_points, const bool &random)
+bool PointCloud::readFromFile(const char* file_name, const int &n_threads)
 {
-    deque<VectorXd> p_aux;
+    shared_ptr<MappedFile> mapped_file = make_shared<MappedFile>();
+    if (!mapped_file->open(file_name))
+    {
+        cerr << "Unable to open file \"" << file_name << "\""<<endl;
+
+        return false;
+    }
 
-    if (n_points > desired_points)
+    if (mapped_file->size() >= sizeof(binary_magic) && memcmp(mapped_file->begin(), binary_magic, sizeof(binary_magic)) == 0)
     {
-        if (!random)
+        if (!setPointsFromBinary(mapped_file))
         {
-            int count = n_points/desired_points;
-
-            for (auto i : irange(0,n_points, count))
-            {
-                p_aux.push_back(points[i]);
-            }
+            cerr << "Invalid binary point cloud file \"" << file_name << "\""<<endl;
+            return false;
         }
-        else
-        {
-            // Use always the same seed for reproducibility
-            srand(1);
-            set<unsigned int> idx;
-            while (idx.size() < desired_points)
-            {
-                unsigned int i = (unsigned int)(rand()%n_points);
-                if (idx.find(i) == idx.end())
-                {
-                    p_aux.push_back(points[i]);
-                    idx.insert(i);
-                }
-             }
 
-        }
+        return true;
     }
 
-    points.clear();
-    for (auto pa : p_aux)
+    const MappedFile &file = *mapped_file;
+
+    // The file is split in chunks made of whole lines
+    const char *begin = file.begin();
+    const char *end = file.end();
+    size_t n_chunks = 1;
+    if (file.size() >= 2*min_chunk_size)
     {
-        points.push_back(pa);
+        size_t threads = (n_threads > 0 ? n_threads : ThreadPool::hardwareThreads());
+        n_chunks = min(file.size()/min_chunk_size, chunks_per_thread*threads);
     }
-    p_aux.clear();
 
-    n_points = points.size();
-}
+    vector<const char*> bounds(n_chunks + 1, end);
+    bounds[0] = begin;
+    for (size_t k = 1; k < n_chunks; k++)
+    {
+        const char *p = max(begin + k*(file.size()/n_chunks), bounds[k - 1]);
+        const char *eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        bounds[k] = (eol != nullptr ? eol + 1 : end);
+    }
 
-/*********************************************/
-bool PointCloud::readFromFile(const char* file_name)
-{
-    deque<Vector3d> all_points;
-    vector<vector<unsigned char>> all_colors;
+    // Lines of each chunk, the last line may have no new line character
+    vector<size_t> lines(n_chunks), offsets(n_chunks + 1, 0);
+    for (size_t k = 0; k < n_chunks; k++)
+    {
+        for (const char *p = bounds[k]; (p = static_cast<const char*>(memchr(p, '\n', bounds[k + 1] - p))) != nullptr; p++)
+            lines[k]++;
+        if (k == n_chunks - 1 && bounds[k + 1] > bounds[k] && *(bounds[k + 1] - 1) != '\n')
+            lines[k]++;
+        offsets[k + 1] = offsets[k] + lines[k];
+    }
+
+    // Each chunk is parsed in its own part of the points
+    vector<Vector3d, aligned_allocator<Vector3d>> all_points(offsets[n_chunks]);
+    vector<unsigned char> all_colors(3*offsets[n_chunks]);
+    vector<size_t> parsed(n_chunks, 0);
 
-    ifstream fin(file_name);
-    if (!fin.is_open())
+    auto parse = [&](const size_t &k)
     {
-        cerr << "Unable to open file \"" << file_name << "\""<<endl;
+        // The parsers do not skip new line characters, so they stop at the end of the line
+        const char *p = bounds[k];
+        for (size_t j = offsets[k]; j < offsets[k + 1]; j++)
+        {
+            if (!parseLine(p, bounds[k + 1], all_points[j], &all_colors[3*j]))
+                break;
 
-        return false;
-    }
+            parsed[k]++;
 
-    Vector3d p(3);
-    vector<unsigned int> c_(3);
-    vector<unsigned char> c(3);
+            const char *eol = static_cast<const char*>(memchr(p, '\n', bounds[k + 1] - p));
+            p = (eol != nullptr ? eol + 1 : bounds[k + 1]);
+        }
+    };
 
-    string line;
+    if (n_chunks > 1)
+    {
+        ThreadPool pool(min((int)n_chunks, n_threads > 0 ? n_threads : ThreadPool::hardwareThreads()));
+        for (size_t k = 0; k < n_chunks; k++)
+            pool.run([&parse, k]() { parse(k); });
+        pool.wait();
+    }
+    else
+        parse(0);
 
-    while (getline(fin,line))
+    // The points after the first line that cannot be parsed are discarded
+    size_t n = 0;
+    for (size_t k = 0; k < n_chunks; k++)
     {
-        istringstream iss(line);
-        if (!(iss >> p(0) >> p(1) >> p(2)))
+        n = offsets[k] + parsed[k];
+        if (parsed[k] < lines[k])
             break;
-        all_points.push_back(p);
-
-        fill(c_.begin(),c_.end(),120);
-        iss >> c_[0] >> c_[1] >> c_[2];
-        c[0]=(unsigned char)c_[0];
-        c[1]=(unsigned char)c_[1];
-        c[2]=(unsigned char)c_[2];
-
-        if (c[0] == c[1] && c[1] == c[2])
-         {
-             c[0] = 50;
-             c[1] = 100;
-             c[2] = 0;
-         }
-
-        all_colors.push_back(c);
     }
 
-    if (all_points.size() == 0)
+    if (n == 0)
     {
         cout << endl;
         cerr << "   No points found in file " << endl << endl;
         return false;
     }
 
-    this->setPoints(all_points);
-    this->setColors(all_colors);
+    all_points.resize(n);
+    all_colors.resize(3*n);
+
+    deletePoints();
+    store = make_shared<PointStore>(move(all_points));
+    n_points = store->size();
+    colors = PointColors(move(all_colors));
 
     return true;
 }
 
 /*********************************************/
-bool PointCloud::readFromFile(const string &file_name)
+bool PointCloud::readFromFile(const string &file_name, const int &n_threads)
 {
-    deque<Vector3d> all_points;
-    vector<vector<unsigned char>> all_colors;
+    return readFromFile(file_name.c_str(), n_threads);
+}
 
-    ifstream fin(file_name);
-    if (!fin.is_open())
+/*********************************************/
+bool PointCloud::writeToBinaryFile(const string &file_name, const bool &single_precision) const
+{
+    int num = getNumberPointsForVis();
+    bool with_colors = ((int)colors.size() == num);
+
+    BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, binary_magic, sizeof(binary_magic));
+    header.byte_order = binary_byte_order;
+    header.version = binary_version;
+    header.scalar_size = (single_precision ? sizeof(float) : sizeof(double));
+    header.count = num;
+    header.stride = 3*header.scalar_size;
+    header.points_offset = binary_points_offset;
+    header.colors_offset = (with_colors ? header.points_offset + header.count*header.stride : 0);
+
+    ofstream fout(file_name, ios::binary);
+    if (!fout.is_open())
     {
         cerr << "Unable to open file \"" << file_name << "\""<<endl;
-
         return false;
     }
 
-    Vector3d p(3);
-    vector<unsigned int> c_(3);
-    vector<unsigned char> c(3);
-
-    string line;
+    vector<char> padding(binary_points_offset - sizeof(header), 0);
+    fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    fout.write(padding.data(), padding.size());
 
-    while (getline(fin,line))
+    // The points are written in blocks
+    const int block = 4096;
+    vector<double> xyz_double(single_precision ? 0 : 3*block);
+    vector<float> xyz_float(single_precision ? 3*block : 0);
+    for (int first = 0; first < num; first += block)
     {
-        istringstream iss(line);
-        if (!(iss >> p(0) >> p(1) >> p(2)))
-            break;
-        all_points.push_back(p);
-
-        fill(c_.begin(),c_.end(),120);
-        iss >> c_[0] >> c_[1] >> c_[2];
-        c[0]=(unsigned char)c_[0];
-        c[1]=(unsigned char)c_[1];
-        c[2]=(unsigned char)c_[2];
-
-        if (c[0] == c[1] && c[1] == c[2])
-         {
-             c[0] = 50;
-             c[1] = 100;
-             c[2] = 0;
-         }
-
-        all_colors.push_back(c);
+        int last = min(first + block, num);
+        for (int i = first; i < last; i++)
+        {
+            Vector3d p = getPointForVis(i);
+            for (int j = 0; j < 3; j++)
+            {
+                if (single_precision)
+                    xyz_float[3*(i - first) + j] = (float)p(j);
+                else
+                    xyz_double[3*(i - first) + j] = p(j);
+            }
+        }
+
+        if (single_precision)
+            fout.write(reinterpret_cast<const char*>(xyz_float.data()), 3*(last - first)*sizeof(float));
+        else
+            fout.write(reinterpret_cast<const char*>(xyz_double.data()), 3*(last - first)*sizeof(double));
     }
 
-    if (all_points.size() == 0)
+    if (with_colors)
+        fout.write(reinterpret_cast<const char*>(colors.data()), 3*num);
+
+    if (!fout.good())
     {
-        cout << endl;
-        cerr << "   No points found in file " << endl << endl;
+        cerr << "Unable to write file \"" << file_name << "\""<<endl;
         return false;
     }
 
-    this->setPoints(all_points);
-    this->setColors(all_colors);
-
     return true;
 }
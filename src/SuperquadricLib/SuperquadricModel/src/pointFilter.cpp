@@ -0,0 +1,377 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+
+/**
+ * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+ */
+
+#include <SuperquadricLibModel/pointFilter.h>
+#include <SuperquadricLibModel/pointCloud.h>
+#include <SuperquadricLibModel/spatialIndex.h>
+#include <SuperquadricLibModel/threadPool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
+
+using namespace std;
+using namespace Eigen;
+using namespace SuperqModel;
+
+namespace {
+
+// Cells processed by each task
+const int chunk_size = 4096;
+
+/*********************************************/
+void forEachCell(const VoxelHash &grid, const double &radius, const int &n_threads,
+                 const function<void(int, const int*, const int*)> &body)
+{
+    // The cells close to the ones of a chunk are found at once
+    auto chunk = [&grid, &radius, &body](const int &begin, const int &end)
+    {
+        vector<int> cells, starts;
+        grid.neighborCells(begin, end, radius, cells, starts);
+        for (int c = begin; c < end; c++)
+            body(c, cells.data() + starts[c - begin], cells.data() + starts[c - begin + 1]);
+    };
+
+    int n = grid.getNumberCells();
+    int n_chunks = (n + chunk_size - 1)/chunk_size;
+    if (n_chunks <= 1 || n_threads == 1)
+    {
+        for (int k = 0; k < n_chunks; k++)
+            chunk(k*chunk_size, min(n, (k + 1)*chunk_size));
+        return;
+    }
+
+    ThreadPool pool(min(n_chunks, n_threads > 0 ? n_threads : ThreadPool::hardwareThreads()));
+    for (int k = 0; k < n_chunks; k++)
+        pool.run([&chunk, k, n]() { chunk(k*chunk_size, min(n, (k + 1)*chunk_size)); });
+    pool.wait();
+}
+
+/*********************************************/
+int findRoot(vector<atomic<int>> &parent, int i)
+{
+    // Path halving, a failed update only leaves a longer path
+    int p = parent[i].load();
+    while (p != i)
+    {
+        int g = parent[p].load();
+        parent[i].compare_exchange_weak(p, g);
+        i = p;
+        p = parent[i].load();
+    }
+
+    return i;
+}
+
+/*********************************************/
+void unite(vector<atomic<int>> &parent, int a, int b)
+{
+    // The larger root is linked to the smaller one, so every root is the
+    // smallest point of its set
+    while (true)
+    {
+        a = findRoot(parent, a);
+        b = findRoot(parent, b);
+        if (a == b)
+            return;
+        if (a < b)
+            swap(a, b);
+
+        int expected = a;
+        if (parent[a].compare_exchange_strong(expected, b))
+            return;
+    }
+}
+
+}
+
+/*********************************************/
+PointFilter::PointFilter(const int &threads) : n_threads(threads)
+{
+}
+
+/*********************************************/
+PointFilter::~PointFilter()
+{
+}
+
+/*********************************************/
+int PointFilter::filter(PointCloud &point_cloud) const
+{
+    int n = point_cloud.getNumberPointsForVis();
+    vector<int> indices;
+    select(point_cloud, indices);
+
+    if ((int)indices.size() == n || indices.empty())
+        return 0;
+
+    PointCloudStats stats;
+    for (size_t i = 0; i < indices.size(); i++)
+        stats.add(point_cloud.getPointForVis(indices[i]));
+
+    // The colors follow the points for vis
+    vector<unsigned char> rgb;
+    if (point_cloud.colors.size() == n)
+    {
+        rgb.resize(3*indices.size());
+        for (size_t i = 0; i < indices.size(); i++)
+            copy(point_cloud.colors[indices[i]], point_cloud.colors[indices[i]] + 3, &rgb[3*i]);
+    }
+
+    point_cloud.setPoints(point_cloud, indices, stats);
+    if (!rgb.empty())
+        point_cloud.setColors(move(rgb));
+
+    return n - indices.size();
+}
+
+/*********************************************/
+DBSCANFilter::DBSCANFilter(const double &r, const int &m, const int &threads) : PointFilter(threads), radius(r), min_points(m)
+{
+}
+
+/*********************************************/
+int DBSCANFilter::cluster(const PointCloud &point_cloud, vector<int> &labels) const
+{
+    int n = point_cloud.getNumberPointsForVis();
+    labels.assign(n, -1);
+    if (n == 0 || radius <= 0.0)
+        return 0;
+
+    // The points of a cell are within the radius of each other, unless the
+    // grid had to enlarge its cells
+    shared_ptr<const VoxelHash> grid = point_cloud.getVoxelHash(radius/sqrt(3.0));
+    bool close_cells = (grid->getCellSize()*sqrt(3.0) <= radius);
+    double sq_radius = radius*radius;
+
+    // The points are handled in the order of the cells, the cells with
+    // enough points are made of core points only
+    vector<char> core(n, 0);
+    forEachCell(*grid, radius, n_threads, [&](int c, const int *neighbors, const int *neighbors_end)
+    {
+        int first, last;
+        grid->getCellRange(c, first, last);
+        if (close_cells && last - first >= min_points)
+        {
+            fill(core.begin() + first, core.begin() + last, 1);
+            return;
+        }
+
+        for (int j = first; j < last; j++)
+        {
+            int count = 0;
+            for (const int *d = neighbors; d != neighbors_end && count < min_points; d++)
+            {
+                int b, e;
+                grid->getCellRange(*d, b, e);
+                for (int k = b; k < e && count < min_points; k++)
+                {
+                    if ((grid->getPoint(k) - grid->getPoint(j)).squaredNorm() <= sq_radius)
+                        count++;
+                }
+            }
+            core[j] = (count >= min_points);
+        }
+    });
+
+    // Two neighboring cells are merged by the first pair of core points within
+    // the radius, border points are attached to their nearest core point
+    vector<atomic<int>> parent(n);
+    for (int j = 0; j < n; j++)
+        parent[j].store(j);
+    vector<int> attached(n, -1);
+
+    forEachCell(*grid, radius, n_threads, [&](int c, const int *neighbors, const int *neighbors_end)
+    {
+        int first, last;
+        grid->getCellRange(c, first, last);
+
+        int first_core = -1;
+        for (int j = first; j < last; j++)
+        {
+            if (!core[j])
+                continue;
+
+            if (first_core < 0)
+                first_core = j;
+            else if (close_cells)
+                unite(parent, first_core, j);
+            else
+            {
+                for (int k = first; k < j; k++)
+                {
+                    if (core[k] && (grid->getPoint(k) - grid->getPoint(j)).squaredNorm() <= sq_radius)
+                        unite(parent, k, j);
+                }
+            }
+        }
+
+        for (const int *d = neighbors; d != neighbors_end && first_core >= 0; d++)
+        {
+            if (*d <= c)
+                continue;
+
+            int b, e;
+            grid->getCellRange(*d, b, e);
+
+            bool merged = false;
+            for (int j = first; j < last && !merged; j++)
+            {
+                if (!core[j])
+                    continue;
+
+                for (int k = b; k < e && !merged; k++)
+                {
+                    if (core[k] && (grid->getPoint(k) - grid->getPoint(j)).squaredNorm() <= sq_radius)
+                    {
+                        unite(parent, j, k);
+                        merged = close_cells;
+                    }
+                }
+            }
+        }
+
+        for (int j = first; j < last; j++)
+        {
+            if (core[j])
+                continue;
+
+            double best = numeric_limits<double>::infinity();
+            for (const int *d = neighbors; d != neighbors_end; d++)
+            {
+                int b, e;
+                grid->getCellRange(*d, b, e);
+                for (int k = b; k < e; k++)
+                {
+                    double dist = (grid->getPoint(k) - grid->getPoint(j)).squaredNorm();
+                    if (core[k] && dist <= sq_radius && (dist < best || (dist == best && k < attached[j])))
+                    {
+                        best = dist;
+                        attached[j] = k;
+                    }
+                }
+            }
+        }
+    });
+
+    // The clusters are numbered in order of their first point
+    vector<int> positions(n);
+    for (int j = 0; j < n; j++)
+        positions[grid->getIndex(j)] = j;
+
+    vector<int> root_labels(n, -1);
+    int n_clusters = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int j = positions[i];
+        if (!core[j] && attached[j] < 0)
+            continue;
+
+        int root = findRoot(parent, core[j] ? j : attached[j]);
+        if (root_labels[root] < 0)
+            root_labels[root] = n_clusters++;
+        labels[i] = root_labels[root];
+    }
+
+    return n_clusters;
+}
+
+/*********************************************/
+void DBSCANFilter::select(const PointCloud &point_cloud, vector<int> &indices) const
+{
+    vector<int> labels;
+    int n_clusters = cluster(point_cloud, labels);
+
+    indices.clear();
+    if (n_clusters == 0)
+        return;
+
+    vector<int> sizes(n_clusters, 0);
+    for (size_t i = 0; i < labels.size(); i++)
+    {
+        if (labels[i] >= 0)
+            sizes[labels[i]]++;
+    }
+
+    int largest = max_element(sizes.begin(), sizes.end()) - sizes.begin();
+    indices.reserve(sizes[largest]);
+    for (size_t i = 0; i < labels.size(); i++)
+    {
+        if (labels[i] == largest)
+            indices.push_back(i);
+    }
+}
+
+/*********************************************/
+RadiusOutlierFilter::RadiusOutlierFilter(const double &r, const double &s, const int &threads) : PointFilter(threads), radius(r), std_ratio(s)
+{
+}
+
+/*********************************************/
+void RadiusOutlierFilter::select(const PointCloud &point_cloud, vector<int> &indices) const
+{
+    int n = point_cloud.getNumberPointsForVis();
+    indices.clear();
+    if (n == 0 || radius <= 0.0)
+        return;
+
+    shared_ptr<const VoxelHash> grid = point_cloud.getVoxelHash(radius/sqrt(3.0));
+    double sq_radius = radius*radius;
+
+    // The neighbors of each point, itself excluded
+    vector<int> counts(n, 0);
+    forEachCell(*grid, radius, n_threads, [&](int c, const int *neighbors, const int *neighbors_end)
+    {
+        int first, last;
+        grid->getCellRange(c, first, last);
+        for (int j = first; j < last; j++)
+        {
+            int count = -1;
+            for (const int *d = neighbors; d != neighbors_end; d++)
+            {
+                int b, e;
+                grid->getCellRange(*d, b, e);
+                for (int k = b; k < e; k++)
+                    count += ((grid->getPoint(k) - grid->getPoint(j)).squaredNorm() <= sq_radius);
+            }
+            counts[grid->getIndex(j)] = count;
+        }
+    });
+
+    double mean = 0.0, sq_mean = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        mean += counts[i];
+        sq_mean += (double)counts[i]*counts[i];
+    }
+    mean /= n;
+    double threshold = mean - std_ratio*sqrt(max(sq_mean/n - mean*mean, 0.0));
+
+    for (int i = 0; i < n; i++)
+    {
+        if (counts[i] >= threshold)
+            indices.push_back(i);
+    }
+}
@@ -0,0 +1,528 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+
+/**
+ * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+ */
+
+#include <SuperquadricLibModel/pointSampler.h>
+#include <SuperquadricLibModel/pointCloud.h>
+#include <SuperquadricLibModel/spatialIndex.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <random>
+
+using namespace std;
+using namespace Eigen;
+using namespace SuperqModel;
+
+namespace {
+
+// Cell coordinates are packed in 21 bits each
+const unsigned long long coord_bits = 21;
+const unsigned long long coord_max = (1ULL << coord_bits) - 1;
+const unsigned long long empty_key = numeric_limits<unsigned long long>::max();
+
+/*********************************************/
+void allPoints(const int &n, vector<int> &indices)
+{
+    indices.resize(n);
+    for (int i = 0; i < n; i++)
+        indices[i] = i;
+}
+
+/*********************************************/
+unsigned long long cellKey(const Vector3d &point, const Vector3d &origin, const double &scale)
+{
+    Vector3d p = (point - origin)*scale;
+
+    unsigned long long key = 0;
+    for (int j = 0; j < 3; j++)
+    {
+        unsigned long long c = (p(j) > 0.0 ? (unsigned long long)p(j) : 0);
+        key = (key << coord_bits) | min(c, coord_max);
+    }
+
+    return key;
+}
+
+/*********************************************/
+void candidatePoints(const PointCloud &point_cloud, const int &candidates, const int &min_candidates,
+                     const int &max_candidates, vector<int> &indices)
+{
+    // Large point clouds are first reduced to uniformly spread candidates
+    int m = min(max(candidates, min_candidates), max_candidates);
+    if (point_cloud.getNumberPoints() > m)
+        VoxelGridSampler().sample(point_cloud, m, indices);
+    else
+        allPoints(point_cloud.getNumberPoints(), indices);
+}
+
+}
+
+/*********************************************/
+PointSampler::PointSampler(const unsigned int &s) : seed(s)
+{
+}
+
+/*********************************************/
+PointSampler::~PointSampler()
+{
+}
+
+/*********************************************/
+PointSampler *PointSampler::create(const string &method)
+{
+    if (method == "stride")
+        return new StrideSampler;
+    else if (method == "random")
+        return new RandomSampler;
+    else if (method == "reservoir")
+        return new ReservoirSampler;
+    else if (method == "voxel")
+        return new VoxelGridSampler;
+    else if (method == "farthest")
+        return new FarthestPointSampler;
+    else if (method == "curvature")
+        return new CurvatureSampler;
+    else
+        return nullptr;
+}
+
+/*********************************************/
+bool PointSampler::isValid(const string &method)
+{
+    return (method == "stride" || method == "random" || method == "reservoir" || method == "voxel" ||
+            method == "farthest" || method == "curvature");
+}
+
+/*********************************************/
+void StrideSampler::sample(const PointCloud &point_cloud, const int &desired_points, vector<int> &indices) const
+{
+    int n = point_cloud.getNumberPoints();
+    if (n <= desired_points)
+    {
+        allPoints(n, indices);
+        return;
+    }
+
+    // Same points as the original downsampling, which may be slightly more than desired
+    int count = n/desired_points;
+
+    indices.clear();
+    indices.reserve(n/count + 1);
+    for (int i = 0; i < n; i += count)
+        indices.push_back(i);
+}
+
+/*********************************************/
+RandomSampler::RandomSampler(const unsigned int &s) : PointSampler(s)
+{
+}
+
+/*********************************************/
+void RandomSampler::sample(const PointCloud &point_cloud, const int &desired_points, vector<int> &indices) const
+{
+    int n = point_cloud.getNumberPoints();
+    if (n <= desired_points)
+    {
+        allPoints(n, indices);
+        return;
+    }
+
+    // The selected indices are kept in an open addressing hash set,
+    // whose size depends only on the number of selected points
+    size_t table_size = 1;
+    while (table_size < 2*(size_t)desired_points)
+        table_size <<= 1;
+    vector<int> table(table_size, -1);
+    size_t mask = table_size - 1;
+
+    mt19937 gen(seed);
+    indices.clear();
+    indices.reserve(desired_points);
+
+    // Floyd's algorithm: for each j, a random index in [0, j] is taken or j itself
+    // if already taken, all the subsets have the same probability
+    for (int j = n - desired_points; j < n; j++)
+    {
+        int t = uniform_int_distribution<int>(0, j)(gen);
+
+        size_t h = ((size_t)t * 2654435761u) & mask;
+        while (table[h] != -1 && table[h] != t)
+            h = (h + 1) & mask;
+
+        if (table[h] == t)
+        {
+            // j has never been drawn, since draws are in [0, j]
+            t = j;
+            h = ((size_t)t * 2654435761u) & mask;
+            while (table[h] != -1)
+                h = (h + 1) & mask;
+        }
+
+        table[h] = t;
+        indices.push_back(t);
+    }
+
+    sort(indices.begin(), indices.end());
+}
+
+/*********************************************/
+ReservoirSampler::ReservoirSampler(const unsigned int &s) : PointSampler(s)
+{
+}
+
+/*********************************************/
+void ReservoirSampler::sample(const PointCloud &point_cloud, const int &desired_points, vector<int> &indices) const
+{
+    int n = point_cloud.getNumberPoints();
+    if (n <= desired_points)
+    {
+        allPoints(n, indices);
+        return;
+    }
+
+    mt19937 gen(seed);
+    uniform_real_distribution<double> uniform(numeric_limits<double>::min(), 1.0);
+    uniform_int_distribution<int> slot(0, desired_points - 1);
+
+    allPoints(desired_points, indices);
+
+    // Algorithm L: the number of points skipped before the next replacement is
+    // drawn directly, so that only O(k log(n/k)) random numbers are needed
+    double w = exp(log(uniform(gen))/desired_points);
+    double i = desired_points - 1;
+
+    while (true)
+    {
+        i += floor(log(uniform(gen))/log1p(-w)) + 1;
+        if (i >= n)
+            break;
+
+        indices[slot(gen)] = (int)i;
+        w *= exp(log(uniform(gen))/desired_points);
+    }
+
+    sort(indices.begin(), indices.end());
+}
+
+/*********************************************/
+bool VoxelGridSampler::fillGrid(const PointCloud &point_cloud, const Vector3d &origin, const double &cell,
+                                const int &max_cells, vector<unsigned long long> &keys, vector<int> &cells) const
+{
+    int n = point_cloud.getNumberPoints();
+    size_t mask = keys.size() - 1;
+    double scale = 1.0/cell;
+
+    // Fibonacci hashing, the slot is given by the highest bits of the product
+    int shift = 64;
+    for (size_t size = keys.size(); size > 1; size >>= 1)
+        shift--;
+
+    fill(keys.begin(), keys.end(), empty_key);
+    cells.clear();
+
+    for (int i = 0; i < n; i++)
+    {
+        unsigned long long key = cellKey(point_cloud.getPoint(i), origin, scale);
+
+        size_t h = (shift < 64 ? (size_t)((key * 0x9E3779B97F4A7C15ULL) >> shift) : 0);
+        while (keys[h] != empty_key && keys[h] != key)
+            h = (h + 1) & mask;
+
+        if (keys[h] == empty_key)
+        {
+            if ((int)cells.size() == max_cells)
+                return false;
+
+            keys[h] = key;
+            cells.push_back(i);
+        }
+    }
+
+    return true;
+}
+
+/*********************************************/
+void VoxelGridSampler::sample(const PointCloud &point_cloud, const int &desired_points, vector<int> &indices) const
+{
+    int n = point_cloud.getNumberPoints();
+    if (n <= desired_points)
+    {
+        allPoints(n, indices);
+        return;
+    }
+
+    PointCloudStats stats = point_cloud.getStats();
+    Vector3d lower = stats.lower, upper = stats.upper;
+
+    Vector3d extent = upper - lower;
+    double min_cell = extent.maxCoeff()/coord_max;
+    if (min_cell <= 0.0)
+    {
+        StrideSampler().sample(point_cloud, desired_points, indices);
+        return;
+    }
+
+    // Grids with too many cells are discarded as soon as they are detected,
+    // so that the hash table depends only on the desired number of points
+    int max_cells = min(n, 8*desired_points);
+    size_t table_size = 1;
+    while (table_size < 2*(size_t)max_cells)
+        table_size <<= 1;
+    vector<unsigned long long> keys(table_size);
+    vector<int> cells, best;
+    cells.reserve(max_cells);
+
+    // Object point clouds are surfaces, so the initial cell size comes from the
+    // area of the bounding box and the number of cells decreases about with the
+    // square of the size. The exponent is then estimated from the last grids, and
+    // the size is updated until the number of cells is a little more than desired
+    double area = extent(0)*extent(1) + extent(1)*extent(2) + extent(0)*extent(2);
+    double cell = max(sqrt(area/desired_points), min_cell);
+    double cell_small = 0.0, cell_large = numeric_limits<double>::infinity();
+    double exponent = 2.0, last_cell = 0.0, last_count = 0.0;
+    bool found = false;
+
+    for (int pass = 0; pass < 12; pass++)
+    {
+        bool complete = fillGrid(point_cloud, lower, cell, max_cells, keys, cells);
+        double count = cells.size();
+
+        if (!complete)
+            cell_small = cell;
+        else if ((int)cells.size() >= desired_points)
+        {
+            if (!found || cells.size() < best.size())
+                best.swap(cells);
+            found = true;
+            cell_small = cell;
+
+            if (best.size() <= 1.25*desired_points)
+                break;
+        }
+        else
+        {
+            // Without enough cells, the most populated grid is used
+            if (!found && cells.size() > best.size())
+                best.swap(cells);
+            cell_large = cell;
+        }
+
+        double previous = cell;
+        if (!complete)
+            cell = cell*2;
+        else
+        {
+            if (last_count > 0.0 && last_count != count)
+                exponent = min(max(log(count/last_count)/log(last_cell/cell), 1.0), 3.0);
+            last_cell = cell;
+            last_count = count;
+
+            cell = cell*pow(count/(1.1*desired_points), 1.0/exponent);
+        }
+
+        // The new size has to be within the known bounds
+        if (cell <= cell_small || cell >= cell_large)
+            cell = (std::isinf(cell_large) ? 2*cell_small : (cell_small > 0.0 ? sqrt(cell_small*cell_large) : cell_large/2));
+
+        if (cell < min_cell)
+        {
+            if (previous == min_cell)
+                break;
+            cell = min_cell;
+        }
+    }
+
+    // The cells are in order of appearance, equally spaced ones are kept
+    int n_cells = best.size();
+    int k = min(desired_points, n_cells);
+    indices.resize(k);
+    for (int j = 0; j < k; j++)
+        indices[j] = best[(size_t)j*n_cells/k];
+
+    sort(indices.begin(), indices.end());
+}
+
+const int FarthestPointSampler::candidates_per_point;
+const int FarthestPointSampler::min_candidates;
+const int FarthestPointSampler::max_candidates;
+const int CurvatureSampler::candidates_per_point;
+const int CurvatureSampler::min_candidates;
+const int CurvatureSampler::max_candidates;
+constexpr double CurvatureSampler::min_weight;
+
+/*********************************************/
+void FarthestPointSampler::sample(const PointCloud &point_cloud, const int &desired_points, vector<int> &indices) const
+{
+    int n = point_cloud.getNumberPoints();
+    if (n <= desired_points)
+    {
+        allPoints(n, indices);
+        return;
+    }
+
+    vector<int> candidates;
+    candidatePoints(point_cloud, candidates_per_point*desired_points, min_candidates, max_candidates, candidates);
+
+    int m = candidates.size();
+    vector<Vector3d, aligned_allocator<Vector3d>> points(m);
+    for (int i = 0; i < m; i++)
+        points[i] = point_cloud.getPoint(candidates[i]);
+
+    // The first point is the farthest from the center of the bounding box,
+    // then each point is the farthest from the ones already selected
+    Vector3d center = point_cloud.getStats().getCenter();
+
+    vector<double> distance(m);
+    int next = 0;
+    for (int i = 0; i < m; i++)
+    {
+        distance[i] = (points[i] - center).squaredNorm();
+        if (distance[i] > distance[next])
+            next = i;
+    }
+
+    fill(distance.begin(), distance.end(), numeric_limits<double>::infinity());
+
+    indices.clear();
+    indices.reserve(desired_points);
+    for (int j = 0; j < desired_points && j < m; j++)
+    {
+        indices.push_back(candidates[next]);
+
+        Vector3d selected = points[next];
+        int farthest = 0;
+        for (int i = 0; i < m; i++)
+        {
+            distance[i] = min(distance[i], (points[i] - selected).squaredNorm());
+            if (distance[i] > distance[farthest])
+                farthest = i;
+        }
+        next = farthest;
+    }
+
+    sort(indices.begin(), indices.end());
+}
+
+/*********************************************/
+CurvatureSampler::CurvatureSampler(const unsigned int &s) : PointSampler(s)
+{
+}
+
+/*********************************************/
+void CurvatureSampler::sample(const PointCloud &point_cloud, const int &desired_points, vector<int> &indices) const
+{
+    int n = point_cloud.getNumberPoints();
+    if (n <= desired_points)
+    {
+        allPoints(n, indices);
+        return;
+    }
+
+    vector<int> candidates;
+    candidatePoints(point_cloud, candidates_per_point*desired_points, min_candidates, max_candidates, candidates);
+
+    int m = candidates.size();
+    vector<Vector3d, aligned_allocator<Vector3d>> points(m);
+    for (int i = 0; i < m; i++)
+        points[i] = point_cloud.getPoint(candidates[i]);
+
+    // The neighbors are searched in a grid whose cells have the size of the
+    // neighborhood, chosen for about 16 neighbors on a surface
+    Vector3d lower = points[0], upper = points[0];
+    for (int i = 1; i < m; i++)
+    {
+        lower = lower.cwiseMin(points[i]);
+        upper = upper.cwiseMax(points[i]);
+    }
+
+    Vector3d extent = upper - lower;
+    double area = extent(0)*extent(1) + extent(1)*extent(2) + extent(0)*extent(2);
+    double radius = max(sqrt(16.0*area/(M_PI*m)), extent.maxCoeff()/coord_max);
+    if (radius <= 0.0)
+    {
+        RandomSampler(seed).sample(point_cloud, desired_points, indices);
+        return;
+    }
+
+    VoxelHash grid(points, radius);
+
+    // Surface variation (smallest eigenvalue over their sum) is high on edges and
+    // corners, the offset of the neighbors centroid is high on boundaries
+    vector<double> variation(m, 0.0), offset(m, 0.0);
+    double max_variation = 0.0, max_offset = 0.0;
+    vector<int> neighbors;
+
+    for (int i = 0; i < m; i++)
+    {
+        Vector3d mean = Vector3d::Zero();
+        Matrix3d moments = Matrix3d::Zero();
+
+        grid.radiusSearch(points[i], radius, neighbors);
+        for (size_t j = 0; j < neighbors.size(); j++)
+        {
+            Vector3d d = points[neighbors[j]] - points[i];
+            mean += d;
+            moments += d*d.transpose();
+        }
+
+        int count = neighbors.size();
+        mean /= count;
+        offset[i] = mean.norm()/radius;
+
+        if (count >= 4)
+        {
+            Matrix3d covariance = moments/count - mean*mean.transpose();
+            SelfAdjointEigenSolver<Matrix3d> solver;
+            solver.computeDirect(covariance, EigenvaluesOnly);
+            Vector3d lambda = solver.eigenvalues().cwiseMax(0.0);
+            if (lambda.sum() > 0.0)
+                variation[i] = lambda(0)/lambda.sum();
+        }
+
+        max_variation = max(max_variation, variation[i]);
+        max_offset = max(max_offset, offset[i]);
+    }
+
+    // Weighted sampling without replacement (Efraimidis-Spirakis): the points
+    // with the largest u^(1/w) are selected, flat regions keep a minimum weight
+    mt19937 gen(seed);
+    uniform_real_distribution<double> uniform(numeric_limits<double>::min(), 1.0);
+
+    vector<pair<double, int>> keys(m);
+    for (int i = 0; i < m; i++)
+    {
+        double w = min_weight + (max_variation > 0.0 ? variation[i]/max_variation : 0.0) +
+                   (max_offset > 0.0 ? offset[i]/max_offset : 0.0);
+        keys[i] = make_pair(log(uniform(gen))/w, candidates[i]);
+    }
+
+    int k = min(desired_points, m);
+    nth_element(keys.begin(), keys.begin() + k - 1, keys.end(), greater<pair<double, int>>());
+
+    indices.resize(k);
+    for (int j = 0; j < k; j++)
+        indices[j] = keys[j].second;
+
+    sort(indices.begin(), indices.end());
+}
@@ -0,0 +1,477 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+
+/**
+ * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+ */
+
+#include <SuperquadricLibModel/spatialIndex.h>
+#include <SuperquadricLibModel/threadPool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+using namespace Eigen;
+using namespace SuperqModel;
+
+namespace {
+
+// Subtrees with fewer points are built by the task of their parent
+const int min_parallel_points = 32768;
+
+// Cell coordinates are packed in 21 bits each
+const int coord_bits = 21;
+const int coord_max = (1 << coord_bits) - 1;
+const unsigned long long empty_key = numeric_limits<unsigned long long>::max();
+
+/*********************************************/
+inline unsigned long long packKey(const int &x, const int &y, const int &z)
+{
+    return ((unsigned long long)x << 2*coord_bits) | ((unsigned long long)y << coord_bits) | (unsigned long long)z;
+}
+
+/*********************************************/
+inline int hashKey(const unsigned long long &key, const int &shift)
+{
+    // Fibonacci hashing, the top bits depend on all the coordinates
+    return (int)((key*0x9E3779B97F4A7C15ULL) >> shift);
+}
+
+}
+
+/*********************************************/
+const int KdTree::leaf_size;
+
+/*********************************************/
+KdTree::KdTree(const Points3d &p, const int &n_threads) : depth(0)
+{
+    int n = p.size();
+    while (((n + (1 << depth) - 1) >> depth) > leaf_size)
+        depth++;
+
+    splits.resize((1 << depth) - 1);
+    axes.resize((1 << depth) - 1);
+
+    ids.resize(n);
+    for (int i = 0; i < n; i++)
+        ids[i] = i;
+
+    if (n_threads != 1 && n >= 2*min_parallel_points)
+    {
+        ThreadPool pool(n_threads);
+        pool.run([this, n, &p, &pool]() { build(0, 0, n, 0, p, &pool); });
+        pool.wait();
+    }
+    else
+        build(0, 0, n, 0, p, nullptr);
+
+    points.resize(n);
+    for (int i = 0; i < n; i++)
+        points[i] = p[ids[i]];
+}
+
+/*********************************************/
+void KdTree::build(const int &node, const int &begin, const int &end, const int &level,
+                   const Points3d &source, ThreadPool *pool)
+{
+    if (level == depth)
+        return;
+
+    Vector3d lower = Vector3d::Constant(numeric_limits<double>::infinity());
+    Vector3d upper = -lower;
+    for (int i = begin; i < end; i++)
+    {
+        lower = lower.cwiseMin(source[ids[i]]);
+        upper = upper.cwiseMax(source[ids[i]]);
+    }
+
+    int axis;
+    (upper - lower).maxCoeff(&axis);
+
+    int mid = begin + (end - begin)/2;
+    nth_element(ids.begin() + begin, ids.begin() + mid, ids.begin() + end,
+                [&source, axis](const int &a, const int &b) { return source[a](axis) < source[b](axis); });
+
+    splits[node] = source[ids[mid]](axis);
+    axes[node] = (unsigned char)axis;
+
+    // The two halves are disjoint ranges of ids
+    int left = 2*node + 1, right = 2*node + 2;
+    if (pool != nullptr && mid - begin >= min_parallel_points)
+        pool->run([this, left, begin, mid, level, &source, pool]() { build(left, begin, mid, level + 1, source, pool); });
+    else
+        build(left, begin, mid, level + 1, source, pool);
+
+    build(right, mid, end, level + 1, source, pool);
+}
+
+/*********************************************/
+int KdTree::size() const
+{
+    return points.size();
+}
+
+/*********************************************/
+void KdTree::searchKnn(const int &node, const int &begin, const int &end, const int &level, const Vector3d &query,
+                       const int &k, vector<pair<double, int>> &heap) const
+{
+    if (level == depth)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            double d = (points[i] - query).squaredNorm();
+            if ((int)heap.size() < k)
+            {
+                heap.push_back(make_pair(d, i));
+                push_heap(heap.begin(), heap.end());
+            }
+            else if (d < heap.front().first)
+            {
+                pop_heap(heap.begin(), heap.end());
+                heap.back() = make_pair(d, i);
+                push_heap(heap.begin(), heap.end());
+            }
+        }
+        return;
+    }
+
+    int mid = begin + (end - begin)/2;
+    double diff = query(axes[node]) - splits[node];
+
+    // The closer half first, the other one only if it may contain closer points
+    if (diff < 0.0)
+        searchKnn(2*node + 1, begin, mid, level + 1, query, k, heap);
+    else
+        searchKnn(2*node + 2, mid, end, level + 1, query, k, heap);
+
+    if ((int)heap.size() < k || diff*diff < heap.front().first)
+    {
+        if (diff < 0.0)
+            searchKnn(2*node + 2, mid, end, level + 1, query, k, heap);
+        else
+            searchKnn(2*node + 1, begin, mid, level + 1, query, k, heap);
+    }
+}
+
+/*********************************************/
+void KdTree::searchRadius(const int &node, const int &begin, const int &end, const int &level, const Vector3d &query,
+                          const double &sq_radius, vector<int> &indices) const
+{
+    if (level == depth)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            if ((points[i] - query).squaredNorm() <= sq_radius)
+                indices.push_back(ids[i]);
+        }
+        return;
+    }
+
+    int mid = begin + (end - begin)/2;
+    double diff = query(axes[node]) - splits[node];
+
+    if (diff < 0.0 || diff*diff <= sq_radius)
+        searchRadius(2*node + 1, begin, mid, level + 1, query, sq_radius, indices);
+    if (diff >= 0.0 || diff*diff <= sq_radius)
+        searchRadius(2*node + 2, mid, end, level + 1, query, sq_radius, indices);
+}
+
+/*********************************************/
+void KdTree::knnSearch(const Vector3d &query, const int &k, vector<int> &indices, vector<double> &sq_distances) const
+{
+    vector<pair<double, int>> heap;
+    heap.reserve(k);
+    if (k > 0 && size() > 0)
+        searchKnn(0, 0, size(), 0, query, k, heap);
+
+    sort_heap(heap.begin(), heap.end());
+
+    indices.resize(heap.size());
+    sq_distances.resize(heap.size());
+    for (size_t i = 0; i < heap.size(); i++)
+    {
+        indices[i] = ids[heap[i].second];
+        sq_distances[i] = heap[i].first;
+    }
+}
+
+/*********************************************/
+void KdTree::radiusSearch(const Vector3d &query, const double &radius, vector<int> &indices) const
+{
+    indices.clear();
+    if (size() > 0 && radius >= 0.0)
+        searchRadius(0, 0, size(), 0, query, radius*radius, indices);
+}
+
+/*********************************************/
+int KdTree::nearest(const Vector3d &query, double &sq_distance) const
+{
+    vector<int> indices;
+    vector<double> sq_distances;
+    knnSearch(query, 1, indices, sq_distances);
+    if (indices.empty())
+        return -1;
+
+    sq_distance = sq_distances[0];
+    return indices[0];
+}
+
+/*********************************************/
+VoxelHash::VoxelHash(const Points3d &p, const double &cell_size) : cell(cell_size), shift(64)
+{
+    int n = p.size();
+    origin.setZero();
+    dims.setOnes();
+    if (n == 0)
+        return;
+
+    Vector3d lower = p[0], upper = p[0];
+    for (int i = 1; i < n; i++)
+    {
+        lower = lower.cwiseMin(p[i]);
+        upper = upper.cwiseMax(p[i]);
+    }
+
+    origin = lower;
+    cell = max(cell, (upper - lower).maxCoeff()/coord_max);
+    if (cell <= 0.0)
+        cell = 1.0;
+
+    for (int j = 0; j < 3; j++)
+        dims(j) = min((int)((upper(j) - lower(j))/cell), coord_max) + 1;
+
+    // Hash table with at least twice as many slots as points while building
+    int bits = 1;
+    while ((1 << bits) < 2*n)
+        bits++;
+    shift = 64 - bits;
+    table.assign(1 << bits, make_pair(empty_key, -1));
+
+    // The points are counted per cell, then placed in the ranges of their cells
+    vector<int> point_cells(n);
+    vector<int> counts;
+    for (int i = 0; i < n; i++)
+    {
+        Vector3d c = (p[i] - origin)/cell;
+        unsigned long long key = packKey(min((int)c(0), dims(0) - 1), min((int)c(1), dims(1) - 1), min((int)c(2), dims(2) - 1));
+
+        int h = hashKey(key, shift);
+        while (table[h].first != empty_key && table[h].first != key)
+            h = (h + 1) & ((1 << bits) - 1);
+
+        if (table[h].first == empty_key)
+        {
+            table[h] = make_pair(key, (int)counts.size());
+            counts.push_back(0);
+            cell_keys.push_back(key);
+        }
+
+        point_cells[i] = table[h].second;
+        counts[table[h].second]++;
+    }
+
+    // The cells are sorted by key, so that neighboring cells are close in memory
+    // and the queries of close points probe the same slots
+    int n_cells = cell_keys.size();
+    vector<int> order(n_cells), rank(n_cells);
+    for (int c = 0; c < n_cells; c++)
+        order[c] = c;
+    sort(order.begin(), order.end(), [this](const int &a, const int &b) { return cell_keys[a] < cell_keys[b]; });
+
+    vector<unsigned long long> sorted_keys(n_cells);
+    vector<int> sorted_counts(n_cells);
+    for (int c = 0; c < n_cells; c++)
+    {
+        rank[order[c]] = c;
+        sorted_keys[c] = cell_keys[order[c]];
+        sorted_counts[c] = counts[order[c]];
+    }
+    cell_keys.swap(sorted_keys);
+    counts.swap(sorted_counts);
+    for (int i = 0; i < n; i++)
+        point_cells[i] = rank[point_cells[i]];
+
+    // The table is rebuilt with twice as many slots as cells
+    int cell_bits = 1;
+    while ((1 << cell_bits) < 2*n_cells)
+        cell_bits++;
+    shift = 64 - cell_bits;
+    table.assign(1 << cell_bits, make_pair(empty_key, -1));
+    for (int c = 0; c < n_cells; c++)
+    {
+        int h = hashKey(cell_keys[c], shift);
+        while (table[h].first != empty_key)
+            h = (h + 1) & ((1 << cell_bits) - 1);
+        table[h] = make_pair(cell_keys[c], c);
+    }
+
+    cell_starts.assign(counts.size() + 1, 0);
+    for (size_t c = 0; c < counts.size(); c++)
+        cell_starts[c + 1] = cell_starts[c] + counts[c];
+
+    vector<int> next(cell_starts.begin(), cell_starts.end() - 1);
+    points.resize(n);
+    ids.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+        int j = next[point_cells[i]]++;
+        points[j] = p[i];
+        ids[j] = i;
+    }
+}
+
+/*********************************************/
+int VoxelHash::size() const
+{
+    return points.size();
+}
+
+/*********************************************/
+double VoxelHash::getCellSize() const
+{
+    return cell;
+}
+
+/*********************************************/
+int VoxelHash::getNumberCells() const
+{
+    return (cell_starts.empty() ? 0 : (int)cell_starts.size() - 1);
+}
+
+/*********************************************/
+void VoxelHash::getCellRange(const int &c, int &begin, int &end) const
+{
+    begin = cell_starts[c];
+    end = cell_starts[c + 1];
+}
+
+/*********************************************/
+int VoxelHash::getIndex(const int &j) const
+{
+    return ids[j];
+}
+
+/*********************************************/
+const Vector3d &VoxelHash::getPoint(const int &j) const
+{
+    return points[j];
+}
+
+/*********************************************/
+void VoxelHash::neighborCells(const int &begin, const int &end, const double &radius, vector<int> &cells, vector<int> &starts) const
+{
+    // Columns of cells along z around a cell, with their half length, such that
+    // the gap between the cells, i.e. the cells between them, is within radius
+    int range = (int)ceil(radius/cell);
+    double sq_range = (radius/cell)*(radius/cell);
+    vector<Vector3i> columns;
+    for (int dx = -range; dx <= range; dx++)
+        for (int dy = -range; dy <= range; dy++)
+        {
+            double gap = pow(max(abs(dx) - 1, 0), 2) + pow(max(abs(dy) - 1, 0), 2);
+            if (gap <= sq_range)
+                columns.push_back(Vector3i(dx, dy, min(range, (int)floor(sqrt(sq_range - gap)) + 1)));
+        }
+
+    // The cells are sorted by key, so the first key of each column grows with
+    // the cell and the columns are found by advancing a cursor
+    int n_cells = getNumberCells();
+    vector<int> cursors(columns.size(), -1);
+    cells.clear();
+    starts.assign(1, 0);
+    for (int c = begin; c < end; c++)
+    {
+        unsigned long long key = cell_keys[c];
+        int x = (int)(key >> 2*coord_bits), y = (int)((key >> coord_bits) & coord_max), z = (int)(key & coord_max);
+
+        for (size_t k = 0; k < columns.size(); k++)
+        {
+            int nx = x + columns[k](0), ny = y + columns[k](1);
+            if (nx < 0 || ny < 0 || nx >= dims(0) || ny >= dims(1))
+                continue;
+
+            unsigned long long first = packKey(nx, ny, max(z - columns[k](2), 0));
+            unsigned long long last = packKey(nx, ny, min(z + columns[k](2), dims(2) - 1));
+
+            int &j = cursors[k];
+            if (j < 0)
+                j = lower_bound(cell_keys.begin(), cell_keys.end(), first) - cell_keys.begin();
+            while (j < n_cells && cell_keys[j] < first)
+                j++;
+
+            for (int i = j; i < n_cells && cell_keys[i] <= last; i++)
+                cells.push_back(i);
+        }
+
+        starts.push_back(cells.size());
+    }
+}
+
+/*********************************************/
+int VoxelHash::findCell(const unsigned long long &key) const
+{
+    int mask = (int)table.size() - 1;
+    int h = hashKey(key, shift);
+    while (table[h].first != empty_key)
+    {
+        if (table[h].first == key)
+            return table[h].second;
+        h = (h + 1) & mask;
+    }
+
+    return -1;
+}
+
+/*********************************************/
+void VoxelHash::radiusSearch(const Vector3d &query, const double &radius, vector<int> &indices) const
+{
+    indices.clear();
+    if (points.empty() || radius < 0.0)
+        return;
+
+    // Range of the cells intersecting the cube around the sphere
+    int first[3], last[3];
+    for (int j = 0; j < 3; j++)
+    {
+        double a = floor((query(j) - radius - origin(j))/cell);
+        double b = floor((query(j) + radius - origin(j))/cell);
+        if (b < 0.0 || a > dims(j) - 1)
+            return;
+
+        first[j] = (int)max(a, 0.0);
+        last[j] = (int)min(b, (double)(dims(j) - 1));
+    }
+
+    double sq_radius = radius*radius;
+    for (int x = first[0]; x <= last[0]; x++)
+        for (int y = first[1]; y <= last[1]; y++)
+            for (int z = first[2]; z <= last[2]; z++)
+            {
+                int c = findCell(packKey(x, y, z));
+                if (c < 0)
+                    continue;
+
+                for (int i = cell_starts[c]; i < cell_starts[c + 1]; i++)
+                {
+                    if ((points[i] - query).squaredNorm() <= sq_radius)
+                        indices.push_back(ids[i]);
+                }
+            }
+}
@@ -0,0 +1,420 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+
+/**
+ * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+ */
+
+#include <cmath>
+
+#include <SuperquadricLibModel/superqKernel.h>
+
+#include <unsupported/Eigen/AutoDiff>
+
+using namespace std;
+using namespace Eigen;
+using namespace SuperqModel;
+
+typedef AutoDiffScalar<Vector11d> ADScalar;
+typedef Matrix<ADScalar, 11, 1> ADVector11d;
+typedef Matrix<ADScalar, 3, 3> ADMatrix3d;
+typedef Matrix<ADScalar, 3, 1> ADVector3d;
+
+/*********************************************/
+void PointsSoA::setPoints(const vector<Vector3d, aligned_allocator<Vector3d>> &p)
+{
+    x.resize(p.size());
+    y.resize(p.size());
+    z.resize(p.size());
+
+    for (size_t i = 0; i < p.size(); i++)
+    {
+        x(i) = p[i](0);
+        y(i) = p[i](1);
+        z(i) = p[i](2);
+    }
+}
+
+/*********************************************/
+void PointsSoA::setPoints(const deque<Vector3d> &p)
+{
+    x.resize(p.size());
+    y.resize(p.size());
+    z.resize(p.size());
+
+    for (size_t i = 0; i < p.size(); i++)
+    {
+        x(i) = p[i](0);
+        y(i) = p[i](1);
+        z(i) = p[i](2);
+    }
+}
+
+/*********************************************/
+void PointsSoA::setPoints(const PointCloud &p)
+{
+    int n = p.getNumberPoints();
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+
+    for (int i = 0; i < n; i++)
+    {
+        Vector3d point = p.getPoint(i);
+        x(i) = point(0);
+        y(i) = point(1);
+        z(i) = point(2);
+    }
+}
+
+/*********************************************/
+int PointsSoA::size() const
+{
+    return x.size();
+}
+
+/*********************************************/
+void PointsSoA::transform(const Matrix3d &R, const Vector3d &t, PointsSoA &out) const
+{
+    out.x = R(0,0)*x + R(0,1)*y + R(0,2)*z + t(0);
+    out.y = R(1,0)*x + R(1,1)*y + R(1,2)*z + t(1);
+    out.z = R(2,0)*x + R(2,1)*y + R(2,2)*z + t(2);
+}
+
+/*********************************************/
+Matrix3d SuperqKernel::rotation(const Vector11d &params)
+{
+    Matrix3d R;
+    R = AngleAxisd(params(8), Vector3d::UnitZ())*
+        AngleAxisd(params(9), Vector3d::UnitY())*
+        AngleAxisd(params(10), Vector3d::UnitZ());
+
+    return R;
+}
+
+/*********************************************/
+static void rotationDerivatives(const Vector11d &params, Matrix3d dR[3])
+{
+    // Derivatives of R = Rz(phi)*Ry(theta)*Rz(psi) w.r.t. the three angles
+    Matrix3d Rz1, Ry, Rz2, dRz1, dRy, dRz2;
+    double c1 = cos(params(8)), s1 = sin(params(8));
+    double c2 = cos(params(9)), s2 = sin(params(9));
+    double c3 = cos(params(10)), s3 = sin(params(10));
+
+    Rz1 << c1, -s1, 0.0, s1, c1, 0.0, 0.0, 0.0, 1.0;
+    Ry << c2, 0.0, s2, 0.0, 1.0, 0.0, -s2, 0.0, c2;
+    Rz2 << c3, -s3, 0.0, s3, c3, 0.0, 0.0, 0.0, 1.0;
+
+    dRz1 << -s1, -c1, 0.0, c1, -s1, 0.0, 0.0, 0.0, 0.0;
+    dRy << -s2, 0.0, c2, 0.0, 0.0, 0.0, -c2, 0.0, -s2;
+    dRz2 << -s3, -c3, 0.0, c3, -s3, 0.0, 0.0, 0.0, 0.0;
+
+    dR[0] = dRz1*Ry*Rz2;
+    dR[1] = Rz1*dRy*Rz2;
+    dR[2] = Rz1*Ry*dRz2;
+}
+
+/*********************************************/
+void SuperqKernel::insideOutside(const Vector11d &params, const Matrix3d &R,
+                                 const PointsSoA &points, ArrayXd &values)
+{
+    // pow(v,p) is computed as exp(p*log(v)), which is vectorized by Eigen
+    // and correctly gives 0 for v = 0
+    const double e1 = params(3), e2 = params(4);
+
+    ArrayXd dx = points.x - params(5);
+    ArrayXd dy = points.y - params(6);
+    ArrayXd dz = points.z - params(7);
+
+    ArrayXd n1 = R(0,0)*dx + R(1,0)*dy + R(2,0)*dz;
+    ArrayXd n2 = R(0,1)*dx + R(1,1)*dy + R(2,1)*dz;
+    ArrayXd n3 = R(0,2)*dx + R(1,2)*dy + R(2,2)*dz;
+
+    ArrayXd A = ((n1.abs()/params(0)).log()*(2.0/e2)).exp() +
+                ((n2.abs()/params(1)).log()*(2.0/e2)).exp();
+
+    values = (A.log()*(e2/e1)).exp() + ((n3.abs()/params(2)).log()*(2.0/e1)).exp();
+}
+
+/*********************************************/
+void SuperqKernel::insideOutside(const Vector11d &params, const PointsSoA &points, ArrayXd &values)
+{
+    insideOutside(params, rotation(params), points, values);
+}
+
+/*********************************************/
+double SuperqKernel::cost(const Vector11d &params, const PointsSoA &points)
+{
+    if (points.size() == 0)
+        return 0.0;
+
+    ArrayXd f;
+    insideOutside(params, points, f);
+
+    ArrayXd r = (f.log()*params(3)).exp() - 1.0;
+
+    return params(0)*params(1)*params(2)*r.square().sum()/points.size();
+}
+
+/*********************************************/
+void SuperqKernel::residualJacobian(const Vector11d &params, const PointsSoA &points,
+                                    ArrayXd &r, MatrixXd &J)
+{
+    // Closed-form derivatives of r = f^e1 - 1, with
+    // f = (|n1/a1|^(2/e2) + |n2/a2|^(2/e2))^(e2/e1) + |n3/a3|^(2/e1)
+    // and n = R^T (p - c). Limits are used where the logarithms vanish
+    const double a1 = params(0), a2 = params(1), a3 = params(2);
+    const double e1 = params(3), e2 = params(4);
+    const int n = points.size();
+
+    Matrix3d R = rotation(params);
+    Matrix3d dR[3];
+    rotationDerivatives(params, dR);
+
+    ArrayXd dx = points.x - params(5);
+    ArrayXd dy = points.y - params(6);
+    ArrayXd dz = points.z - params(7);
+
+    ArrayXd n1 = R(0,0)*dx + R(1,0)*dy + R(2,0)*dz;
+    ArrayXd n2 = R(0,1)*dx + R(1,1)*dy + R(2,1)*dz;
+    ArrayXd n3 = R(0,2)*dx + R(1,2)*dy + R(2,2)*dz;
+
+    ArrayXd lu = (n1.abs()/a1).log();
+    ArrayXd lv = (n2.abs()/a2).log();
+    ArrayXd lw = (n3.abs()/a3).log();
+
+    ArrayXd U = (lu*(2.0/e2)).exp();
+    ArrayXd V = (lv*(2.0/e2)).exp();
+    ArrayXd A = U + V;
+    ArrayXd lA = A.log();
+    ArrayXd B = (lA*(e2/e1)).exp();
+    ArrayXd C = (lw*(2.0/e1)).exp();
+    ArrayXd f = B + C;
+    ArrayXd lf = f.log();
+    ArrayXd g = (lf*e1).exp();
+
+    r = g - 1.0;
+
+    ArrayXd zero = ArrayXd::Zero(n);
+    ArrayXd B_A = (A > 0.0).select(B/A, zero);
+    ArrayXd lnA = (A > 0.0).select(lA, zero);
+    ArrayXd Ulnu = (U > 0.0).select(U*lu, zero);
+    ArrayXd Vlnv = (V > 0.0).select(V*lv, zero);
+    ArrayXd Clnw = (C > 0.0).select(C*lw, zero);
+
+    // Derivatives of f w.r.t. the superquadric frame coordinates
+    ArrayXd df_n1 = (n1 != 0.0).select(2.0/e1*B_A*U/n1, zero);
+    ArrayXd df_n2 = (n2 != 0.0).select(2.0/e1*B_A*V/n2, zero);
+    ArrayXd df_n3 = (n3 != 0.0).select(2.0/e1*C/n3, zero);
+
+    // Chain rule from f to r = f^e1 - 1
+    ArrayXd dg_df = (f > 0.0).select(e1*g/f, zero);
+
+    J.resize(n, 11);
+
+    J.col(0) = (dg_df*(-2.0/e1*B_A*U/a1)).matrix();
+    J.col(1) = (dg_df*(-2.0/e1*B_A*V/a2)).matrix();
+    J.col(2) = (dg_df*(-2.0/e1*C/a3)).matrix();
+    J.col(3) = (dg_df*(-B*e2/(e1*e1)*lnA - 2.0/(e1*e1)*Clnw) +
+                (f > 0.0).select(g*lf, zero)).matrix();
+    J.col(4) = (dg_df*(A > 0.0).select(B/e1*(lnA - 2.0/e2*(Ulnu + Vlnv)/A), zero)).matrix();
+
+    for (int j = 0; j < 3; j++)
+        J.col(5 + j) = (-dg_df*(R(j,0)*df_n1 + R(j,1)*df_n2 + R(j,2)*df_n3)).matrix();
+
+    for (int m = 0; m < 3; m++)
+    {
+        ArrayXd dn1 = dR[m](0,0)*dx + dR[m](1,0)*dy + dR[m](2,0)*dz;
+        ArrayXd dn2 = dR[m](0,1)*dx + dR[m](1,1)*dy + dR[m](2,1)*dz;
+        ArrayXd dn3 = dR[m](0,2)*dx + dR[m](1,2)*dy + dR[m](2,2)*dz;
+
+        J.col(8 + m) = (dg_df*(df_n1*dn1 + df_n2*dn2 + df_n3*dn3)).matrix();
+    }
+}
+
+/*********************************************/
+double SuperqKernel::costGradient(const Vector11d &params, const PointsSoA &points, Vector11d &grad)
+{
+    grad.setZero();
+
+    if (points.size() == 0)
+        return 0.0;
+
+    ArrayXd r;
+    MatrixXd J;
+    residualJacobian(params, points, r, J);
+
+    // F = K * sum_i r_i^2, with K = a1*a2*a3/N
+    double K = params(0)*params(1)*params(2)/points.size();
+    double sum_r2 = r.square().sum();
+
+    grad = 2.0*K*J.transpose()*r.matrix();
+    grad(0) += K/params(0)*sum_r2;
+    grad(1) += K/params(1)*sum_r2;
+    grad(2) += K/params(2)*sum_r2;
+
+    return K*sum_r2;
+}
+
+/*********************************************/
+static void rotationDerivatives(const ADVector11d &x, ADMatrix3d &R, ADMatrix3d dR[3])
+{
+    // Same as rotationDerivatives, carrying the derivatives w.r.t. the parameters
+    ADScalar c1 = cos(x(8)), s1 = sin(x(8));
+    ADScalar c2 = cos(x(9)), s2 = sin(x(9));
+    ADScalar c3 = cos(x(10)), s3 = sin(x(10));
+    ADScalar zero(0.0), one(1.0);
+
+    ADMatrix3d Rz1, Ry, Rz2, dRz1, dRy, dRz2;
+    Rz1 << c1, -s1, zero, s1, c1, zero, zero, zero, one;
+    Ry << c2, zero, s2, zero, one, zero, -s2, zero, c2;
+    Rz2 << c3, -s3, zero, s3, c3, zero, zero, zero, one;
+
+    dRz1 << -s1, -c1, zero, c1, -s1, zero, zero, zero, zero;
+    dRy << -s2, zero, c2, zero, zero, zero, -c2, zero, -s2;
+    dRz2 << -s3, -c3, zero, c3, -s3, zero, zero, zero, zero;
+
+    R = Rz1*Ry*Rz2;
+    dR[0] = dRz1*Ry*Rz2;
+    dR[1] = Rz1*dRy*Rz2;
+    dR[2] = Rz1*Ry*dRz2;
+}
+
+/*********************************************/
+static void residualGradient(const ADVector11d &x, const ADMatrix3d &R, const ADMatrix3d dR[3],
+                             const double &px, const double &py, const double &pz,
+                             ADScalar &r, ADVector11d &dr)
+{
+    // Scalar version of residualJacobian for a single point
+    const ADScalar &a1 = x(0), &a2 = x(1), &a3 = x(2);
+    const ADScalar &e1 = x(3), &e2 = x(4);
+
+    ADVector3d d;
+    d << px - x(5), py - x(6), pz - x(7);
+    ADVector3d n = R.transpose()*d;
+
+    ADScalar u = abs(n(0))/a1;
+    ADScalar v = abs(n(1))/a2;
+    ADScalar w = abs(n(2))/a3;
+
+    ADScalar lu(0.0), lv(0.0), lw(0.0), U(0.0), V(0.0), C(0.0);
+    if (u > 0.0)
+    {
+        lu = log(u);
+        U = exp(2.0/e2*lu);
+    }
+    if (v > 0.0)
+    {
+        lv = log(v);
+        V = exp(2.0/e2*lv);
+    }
+    if (w > 0.0)
+    {
+        lw = log(w);
+        C = exp(2.0/e1*lw);
+    }
+
+    ADScalar A = U + V;
+    ADScalar lnA(0.0), B(0.0), B_A(0.0);
+    if (A > 0.0)
+    {
+        lnA = log(A);
+        B = exp(e2/e1*lnA);
+        B_A = B/A;
+    }
+
+    ADScalar f = B + C;
+    ADScalar lf(0.0), g(0.0), dg_df(0.0);
+    if (f > 0.0)
+    {
+        lf = log(f);
+        g = exp(e1*lf);
+        dg_df = e1*g/f;
+    }
+
+    r = g - 1.0;
+
+    ADVector3d df_n;
+    df_n(0) = (n(0) != 0.0) ? ADScalar(2.0/e1*B_A*U/n(0)) : ADScalar(0.0);
+    df_n(1) = (n(1) != 0.0) ? ADScalar(2.0/e1*B_A*V/n(1)) : ADScalar(0.0);
+    df_n(2) = (n(2) != 0.0) ? ADScalar(2.0/e1*C/n(2)) : ADScalar(0.0);
+
+    ADVector11d df;
+    df(0) = -2.0/e1*B_A*U/a1;
+    df(1) = -2.0/e1*B_A*V/a2;
+    df(2) = -2.0/e1*C/a3;
+    df(3) = -B*e2/(e1*e1)*lnA - 2.0/(e1*e1)*C*lw;
+    df(4) = (A > 0.0) ? ADScalar(B/e1*(lnA - 2.0/e2*(U*lu + V*lv)/A)) : ADScalar(0.0);
+    df.segment(5,3) = -R*df_n;
+    for (int m = 0; m < 3; m++)
+        df(8 + m) = df_n.dot(dR[m].transpose()*d);
+
+    for (int j = 0; j < 11; j++)
+        dr(j) = dg_df*df(j);
+    dr(3) += g*lf;
+}
+
+/*********************************************/
+double SuperqKernel::costHessian(const Vector11d &params, const PointsSoA &points, Matrix11d &hess)
+{
+    hess.setZero();
+
+    if (points.size() == 0)
+        return 0.0;
+
+    // The gradient is differentiated once more in forward mode: every
+    // quantity carries its derivatives w.r.t. the 11 parameters
+    ADVector11d x;
+    for (int i = 0; i < 11; i++)
+        x(i) = ADScalar(params(i), 11, i);
+
+    ADMatrix3d R, dR[3];
+    rotationDerivatives(x, R, dR);
+
+    ADScalar sum_r2(0.0);
+    ADVector11d sum_grad;
+    for (int j = 0; j < 11; j++)
+        sum_grad(j) = ADScalar(0.0);
+
+    for (int i = 0; i < points.size(); i++)
+    {
+        ADScalar r;
+        ADVector11d dr;
+        residualGradient(x, R, dR, points.x(i), points.y(i), points.z(i), r, dr);
+
+        sum_r2 += r*r;
+        for (int j = 0; j < 11; j++)
+            sum_grad(j) += 2.0*r*dr(j);
+    }
+
+    ADScalar K = x(0)*x(1)*x(2)/double(points.size());
+
+    for (int j = 0; j < 11; j++)
+    {
+        ADScalar grad_j = K*sum_grad(j);
+        if (j < 3)
+            grad_j += K/x(j)*sum_r2;
+
+        hess.row(j) = grad_j.derivatives().transpose();
+    }
+
+    // Remove the asymmetry due to round-off
+    hess = 0.5*(hess + hess.transpose()).eval();
+
+    return K.value()*sum_r2.value();
+}
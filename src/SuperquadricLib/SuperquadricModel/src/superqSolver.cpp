@@ -0,0 +1,309 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+
+/**
+ * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+ */
+
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <iostream>
+
+#include <SuperquadricLibModel/superqSolver.h>
+
+using namespace std;
+using namespace Eigen;
+using namespace SuperqModel;
+
+/*********************************************/
+SuperqSolver::SuperqSolver() : iterations(0), concurrent(false)
+{
+}
+
+/*********************************************/
+SuperqSolver::~SuperqSolver()
+{
+}
+
+/*********************************************/
+SuperqSolver *SuperqSolver::create(const string &name, const bool &concurrent)
+{
+    SuperqSolver *solver;
+    if (name == "levenberg-marquardt")
+        solver = new LevenbergMarquardtSolver;
+    else
+        solver = new IpoptSuperqSolver;
+
+    solver->concurrent = concurrent;
+    return solver;
+}
+
+/*********************************************/
+int SuperqSolver::getIterations() const
+{
+    return iterations;
+}
+
+/*********************************************/
+double SuperqSolver::getSetupTimeSaved() const
+{
+    return 0.0;
+}
+
+/*********************************************/
+IpoptSession::IpoptSession(const bool &constraints) : with_constraints(constraints), setup_time(0.0),
+                                                      setup_time_saved(0.0), reuses(0)
+{
+}
+
+/*********************************************/
+bool IpoptSession::sameOptions(const IpoptParam &pars) const
+{
+    return (pars.tol == session_pars.tol &&
+            (!with_constraints || pars.constr_tol == session_pars.constr_tol) &&
+            pars.acceptable_iter == session_pars.acceptable_iter &&
+            pars.mu_strategy == session_pars.mu_strategy &&
+            pars.max_iter == session_pars.max_iter &&
+            pars.max_cpu_time == session_pars.max_cpu_time &&
+            pars.nlp_scaling_method == session_pars.nlp_scaling_method &&
+            pars.hessian_approximation == session_pars.hessian_approximation &&
+            pars.print_level == session_pars.print_level &&
+            pars.derivative_test == session_pars.derivative_test &&
+            pars.warm_start == session_pars.warm_start);
+}
+
+/*********************************************/
+Ipopt::SmartPtr<Ipopt::IpoptApplication> IpoptSession::get(const IpoptParam &pars)
+{
+    if (IsValid(app) && sameOptions(pars))
+    {
+        reuses++;
+        setup_time_saved += setup_time;
+
+        return app;
+    }
+
+    clock_t tStart = clock();
+
+    app = new Ipopt::IpoptApplication;
+    app->Options()->SetNumericValue("tol",pars.tol);
+    if (with_constraints)
+        app->Options()->SetNumericValue("constr_viol_tol",pars.constr_tol);
+    app->Options()->SetIntegerValue("acceptable_iter",pars.acceptable_iter);
+    app->Options()->SetStringValue("mu_strategy",pars.mu_strategy);
+    app->Options()->SetIntegerValue("max_iter",pars.max_iter);
+    app->Options()->SetNumericValue("max_cpu_time",pars.max_cpu_time);
+    app->Options()->SetStringValue("nlp_scaling_method",pars.nlp_scaling_method);
+    app->Options()->SetStringValue("hessian_approximation",pars.hessian_approximation);
+    app->Options()->SetIntegerValue("print_level",pars.print_level);
+    app->Options()->SetStringValue("derivative_test",pars.derivative_test);
+    if (pars.warm_start)
+    {
+        // Start close to the given point and multipliers
+        app->Options()->SetStringValue("warm_start_init_point","yes");
+        app->Options()->SetNumericValue("warm_start_bound_push",1e-6);
+        app->Options()->SetNumericValue("warm_start_mult_bound_push",1e-6);
+        app->Options()->SetNumericValue("mu_init",1e-4);
+    }
+    app->Initialize();
+
+    setup_time = (double)(clock() - tStart)/CLOCKS_PER_SEC;
+    session_pars = pars;
+
+    return app;
+}
+
+/*********************************************/
+double IpoptSession::getSetupTimeSaved() const
+{
+    return setup_time_saved;
+}
+
+/*********************************************/
+int IpoptSession::getReuses() const
+{
+    return reuses;
+}
+
+/*********************************************/
+mutex &IpoptSession::optimizationMutex()
+{
+    static mutex optimization_mutex;
+    return optimization_mutex;
+}
+
+/*********************************************/
+Ipopt::ApplicationReturnStatus IpoptSuperqSolver::solve(const IpoptParam &pars, const Ipopt::SmartPtr<SuperqEstimator> &estim)
+{
+    // When concurrent, the cpu time of the process also counts the solves of the
+    // other threads, the time of this solve is limited by the estimator instead
+    IpoptParam session_pars = pars;
+    if (concurrent)
+        session_pars.max_cpu_time = 1e6;
+
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = (pars.warm_start ? warm_session.get(session_pars) : session.get(session_pars));
+
+    lock_guard<mutex> lock(IpoptSession::optimizationMutex());
+
+    if (concurrent)
+        estim->setTimeLimit(pars.max_cpu_time);
+    Ipopt::ApplicationReturnStatus status = app->OptimizeTNLP(GetRawPtr(estim));
+
+    if (status == Ipopt::User_Requested_Stop && estim->timeExpired())
+        status = Ipopt::Maximum_CpuTime_Exceeded;
+
+    Ipopt::SmartPtr<Ipopt::SolveStatistics> stats = app->Statistics();
+    iterations = IsValid(stats) ? stats->IterationCount() : 0;
+
+    return status;
+}
+
+/*********************************************/
+double IpoptSuperqSolver::getSetupTimeSaved() const
+{
+    return session.getSetupTimeSaved() + warm_session.getSetupTimeSaved();
+}
+
+/*********************************************/
+Ipopt::ApplicationReturnStatus LevenbergMarquardtSolver::solve(const IpoptParam &pars, const Ipopt::SmartPtr<SuperqEstimator> &estim)
+{
+    // The time of this solve only: the process cpu time also counts the
+    // solves running concurrently on other threads
+    chrono::steady_clock::time_point tStart = chrono::steady_clock::now();
+
+    Vector11d x;
+    Matrix112d bounds;
+    estim->getProblem(x, bounds);
+
+    x = x.cwiseMax(bounds.col(0)).cwiseMin(bounds.col(1));
+
+    ArrayXd rho, rho_new;
+    MatrixXd J, J_new;
+    double cost = estim->residuals(x, rho, J);
+
+    // Close to the solution when warm started, Gauss-Newton steps are trusted more
+    double lambda = (pars.warm_start ? 1e-6 : 1e-3);
+    Ipopt::ApplicationReturnStatus status = Ipopt::Maximum_Iterations_Exceeded;
+
+    for (iterations = 0; iterations < pars.max_iter; iterations++)
+    {
+        if (estim->cancelled())
+        {
+            status = Ipopt::User_Requested_Stop;
+            break;
+        }
+
+        if (chrono::duration<double>(chrono::steady_clock::now() - tStart).count() > pars.max_cpu_time)
+        {
+            status = Ipopt::Maximum_CpuTime_Exceeded;
+            break;
+        }
+
+        // Half of the gradient and Gauss-Newton approximation of the hessian
+        Vector11d g = J.transpose()*rho.matrix();
+        Matrix11d H = J.transpose()*J;
+
+        // Variables on a bound with the gradient pointing outwards stay fixed
+        Matrix<bool, 11, 1> free_var;
+        double g_proj = 0.0;
+        for (int j = 0; j < 11; j++)
+        {
+            free_var(j) = !((x(j) <= bounds(j,0) && g(j) > 0.0) || (x(j) >= bounds(j,1) && g(j) < 0.0));
+            if (free_var(j))
+                g_proj = max(g_proj, 2.0*abs(g(j))*max(abs(x(j)), 1e-3));
+        }
+
+        // The cost and the variables have no natural scale, hence the gradient
+        // is compared as relative change of the cost w.r.t. relative change of x
+        if (g_proj <= pars.tol*cost)
+        {
+            status = Ipopt::Solve_Succeeded;
+            break;
+        }
+
+        bool accepted = false;
+        double cost_new = cost;
+        Vector11d x_new;
+
+        while (!accepted && lambda < 1e10)
+        {
+            // Damped normal equations, with the scaling of Marquardt
+            Matrix11d A = H;
+            for (int j = 0; j < 11; j++)
+            {
+                A(j,j) += lambda*max(H(j,j), 1e-12);
+
+                if (!free_var(j))
+                {
+                    A.row(j).setZero();
+                    A.col(j).setZero();
+                    A(j,j) = 1.0;
+                }
+            }
+
+            Vector11d b = -g;
+            for (int j = 0; j < 11; j++)
+            {
+                if (!free_var(j))
+                    b(j) = 0.0;
+            }
+
+            Vector11d delta = A.ldlt().solve(b);
+            x_new = (x + delta).cwiseMax(bounds.col(0)).cwiseMin(bounds.col(1));
+            cost_new = estim->residuals(x_new, rho_new, J_new);
+
+            if (cost_new < cost)
+            {
+                accepted = true;
+                lambda = max(lambda/3.0, 1e-12);
+            }
+            else
+                lambda *= 4.0;
+        }
+
+        if (!accepted)
+        {
+            // No descent step along the feasible directions: local minimum
+            status = Ipopt::Solve_Succeeded;
+            break;
+        }
+
+        double decrease = cost - cost_new;
+        double step = (x_new - x).lpNorm<Infinity>();
+
+        x = x_new;
+        cost = cost_new;
+        rho.swap(rho_new);
+        J.swap(J_new);
+
+        if (decrease <= pars.tol*cost || step <= 1e-12*(1.0 + x.lpNorm<Infinity>()))
+        {
+            iterations++;
+            status = Ipopt::Solve_Succeeded;
+            break;
+        }
+    }
+
+    if (pars.print_level > 0)
+        cout << "|| Levenberg-Marquardt iterations                       :  " << iterations << endl;
+
+    estim->setSolution(x);
+
+    return status;
+}
@@ -21,6 +21,7 @@
  */
 
 #include <SuperquadricLibModel/superquadric.h>
+#include <SuperquadricLibModel/superqKernel.h>
 
 #include <iostream>
 
@@ -194,9 +195,8 @@ Matrix3d Superquadric::getSuperqAxes() const
 }
 
 /*********************************************/
-double Superquadric::insideOutsideF(const VectorXd &pose, const Vector3d &point) const
+bool Superquadric::insideOutsideF(const VectorXd &pose, const PointsSoA &points, ArrayXd &values) const
 {
-    Vector3d c = pose.head(3);
     Matrix3d axes;
 
     if (pose.size() == 6)
@@ -208,19 +208,34 @@ double Superquadric::insideOutsideF(const VectorXd &pose, const Vector3d &point)
     }
     else if (pose.size() == 7)
     {
-        axes = AngleAxisd(pose(6), pose.segment(3,5));
+        axes = AngleAxisd(pose(6), pose.segment(3,3));
     }
     else
     {
         cout << " =====> Error in insideOutsideF: Wrong dimensions of pose vector! " << endl;
-        return 0.0;
+        values.setZero(points.size());
+        return false;
     }
 
-    double num1 = axes.col(0).dot(point - c);
-    double num2 = axes.col(1).dot(point - c);
-    double num3 = axes.col(2).dot(point - c);
+    // The orientation is passed to the kernel, so the angles in x are not used
+    Vector11d x;
+    x << dim, exp, pose.head(3), Vector3d::Zero();
+    SuperqKernel::insideOutside(x, axes, points, values);
+
+    return true;
+}
+
+/*********************************************/
+double Superquadric::insideOutsideF(const VectorXd &pose, const Vector3d &point) const
+{
+    PointsSoA points;
+    points.x.setConstant(1, point(0));
+    points.y.setConstant(1, point(1));
+    points.z.setConstant(1, point(2));
 
-    double inner = pow(abs(num1/dim(0)), 2.0/exp(1)) + pow(abs(num2/dim(1)), 2.0/exp(1));
+    ArrayXd values;
+    if (!insideOutsideF(pose, points, values))
+        return 0.0;
 
-    return pow(abs(inner), exp(1)/exp(0)) + pow(abs(num3/dim(2)), (2.0/exp(0)));
+    return values(0);
 }
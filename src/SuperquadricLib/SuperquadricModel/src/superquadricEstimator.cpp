@@ -19,12 +19,19 @@
  * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
  */
 
+#include <chrono>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
 #include <ctime>
 
 #include <SuperquadricLibModel/superquadricEstimator.h>
+#include <SuperquadricLibModel/superqSolver.h>
+#include <SuperquadricLibModel/threadPool.h>
 
 using namespace std;
 using namespace Eigen;
@@ -35,25 +42,40 @@ void SuperqEstimator::init()
 {
     points_downsampled.deletePoints();
     aux_objvalue = 0.0;
+    aux_grad.setZero();
+    aux_valid = false;
+    warm_start = false;
+    z_lower.setOnes();
+    z_upper.setOnes();
+    cancel_flag = nullptr;
+    time_limited = false;
+    time_expired = false;
 }
 
 /****************************************************************/
-void SuperqEstimator::setPoints(PointCloud &point_cloud, const int &optimizer_points, const bool &random)
+void SuperqEstimator::setPoints(const PointCloud &point_cloud, const int &optimizer_points, const bool &random)
 {
-    // Set points from point cloud and downsample them if too many
-    if (point_cloud.getNumberPoints() > optimizer_points)
-        point_cloud.subSample(optimizer_points, random);
+    setPoints(point_cloud, optimizer_points, string(random ? "random" : "stride"));
+}
 
+/****************************************************************/
+void SuperqEstimator::setPoints(const PointCloud &point_cloud, const int &optimizer_points, const string &sampling_method)
+{
+    // Set points from point cloud and downsample them if too many. Only the view
+    // is downsampled, the points of the input point cloud are shared
     points_downsampled = point_cloud;
+    if (points_downsampled.getNumberPoints() > optimizer_points)
+        points_downsampled.subSample(optimizer_points, sampling_method);
 
     used_points = points_downsampled.getNumberPoints();
 
-    cout << "|| Downsampled points used for modeling                 :  " << used_points << endl;
+    // Points are stored once as a structure of arrays for the cost evaluation
+    points_soa.setPoints(points_downsampled);
 
     x0.resize(11);
     x0.setZero();
     // Compute initial estimate of superquadric
-    computeX0(x0, point_cloud);
+    computeX0(x0, points_downsampled);
 }
 
 /****************************************************************/
@@ -64,11 +86,29 @@ void SuperqEstimator::computeX0(Vector11d &x0, PointCloud &point_cloud)
     x0(4) = (bounds(4,0) + bounds(4,1))/2;
     x0(5) = x0(6) = x0(7) = 0.0;
 
-    // Initial orientation is obtained from point cloud
+    // Initial orientation and center are obtained from the statistics
+    // of the point cloud, computed in a single pass
+    PointCloudStats stats = point_cloud.getStats();
     Matrix3d orientation;
-    orientation = point_cloud.getAxes();
+    orientation = stats.getAxes();
     x0.segment(8,3) = orientation.eulerAngles(2,1,2);
 
+    // Eigen returns the last two angles in [-pi, pi]: the equivalent angles
+    // within the optimization bounds are used, instead of letting the solver
+    // clip them to a different orientation
+    if (x0(9) < 0.0)
+    {
+        x0(8) += M_PI;
+        x0(9) = -x0(9);
+        x0(10) += M_PI;
+    }
+    for (int j = 8; j <= 10; j += 2)
+    {
+        x0(j) = fmod(x0(j), 2.0*M_PI);
+        if (x0(j) < 0.0)
+            x0(j) += 2.0*M_PI;
+    }
+
     // Initial value for superquadric dimensions is obtained from point cloud
     // bounding boxes
     Matrix32d bounding_box(3,2);
@@ -79,7 +119,7 @@ void SuperqEstimator::computeX0(Vector11d &x0, PointCloud &point_cloud)
     x0(2) = (-bounding_box(2,0) + bounding_box(2,1))/2;
 
     // Intial value of the superquadric center is obtained from the point cloud
-    Vector3d barycenter = point_cloud.getBarycenter();
+    Vector3d barycenter = stats.getCenter();
     x0(5) = barycenter(0);
     x0(6) = barycenter(1);
     x0(7) = barycenter(2);
@@ -91,7 +131,9 @@ bool SuperqEstimator::get_nlp_info(Ipopt::Index &n, Ipopt::Index &m,Ipopt::Index
 {
     // Number of variable to estimate is 11, the parameters of the object superquadric
     n = 11;
-    m = nnz_jac_g = nnz_h_lag = 0;
+    m = nnz_jac_g = 0;
+    // Dense lower triangle of the hessian, used only if hessian_approximation is exact
+    nnz_h_lag = 66;
     index_style = TNLP::C_STYLE;
 
     return true;
@@ -100,6 +142,13 @@ bool SuperqEstimator::get_nlp_info(Ipopt::Index &n, Ipopt::Index &m,Ipopt::Index
 /****************************************************************/
 void SuperqEstimator::computeBounds()
 {
+    // Bounds around the previous estimate are computed in setWarmStart
+    if (warm_start)
+    {
+        bounds = warm_bounds;
+        return;
+    }
+
     // Compute bounds starting from x0
     bounds(0,1) = x0(0)*1.5;
     bounds(1,1) = x0(1)*1.5;
@@ -150,6 +199,16 @@ bool SuperqEstimator::get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Num
          x[i] = x0[i];
      }
 
+     // Bound multipliers are requested only if warm_start_init_point is set
+     if (init_z)
+     {
+         for (Ipopt::Index i = 0; i < n;  i++)
+         {
+             z_L[i] = z_lower[i];
+             z_U[i] = z_upper[i];
+         }
+     }
+
      return true;
 }
 
@@ -167,98 +226,144 @@ bool SuperqEstimator::eval_f(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
 /****************************************************************/
 void SuperqEstimator::F(const Ipopt::Number *x, bool &new_x)
 {
-    if (new_x)
+    // Cost and gradient are computed together and cached until x changes
+    if (new_x || !aux_valid)
     {
-         double value = 0.0;
-         for(auto point : points_downsampled.points)
-         {
-             double tmp = pow(f(x,point),x[3]) - 1;
-             value += tmp*tmp;
-         }
-         value *= x[0]*x[1]*x[2]/used_points;
-         aux_objvalue = value;
+        Vector11d x_tmp;
+        for (int i = 0; i < 11; i++)
+            x_tmp(i) = x[i];
+
+        aux_objvalue = F_grad(x_tmp, aux_grad);
+        aux_valid = true;
     }
 }
 
 /****************************************************************/
-double SuperqEstimator::f(const Ipopt::Number *x, const Vector3d &point_cloud)
+double SuperqEstimator::F_v(const Vector11d &x)
 {
-     Vector3d euler;
-     euler(0) = x[8];
-     euler(1) =x [9];
-     euler(2) = x[10];
-     Matrix3d R;
-     R = AngleAxisd(euler(0), Vector3d::UnitZ())*
-         AngleAxisd(euler(1), Vector3d::UnitY())*
-         AngleAxisd(euler(2), Vector3d::UnitZ());
-
-     double num1 = R(0,0)*point_cloud(0) + R(1,0)*point_cloud(1) + R(2,0)*point_cloud(2) - x[5]*R(0,0) - x[6]*R(1,0) - x[7]*R(2,0);
-     double num2 = R(0,1)*point_cloud(0) + R(1,1)*point_cloud(1) + R(2,1)*point_cloud(2) - x[5]*R(0,1) - x[6]*R(1,1) - x[7]*R(2,1);
-     double num3 = R(0,2)*point_cloud(0) + R(1,2)*point_cloud(1) + R(2,2)*point_cloud(2) - x[5]*R(0,2) - x[6]*R(1,2) - x[7]*R(2,2);
-     double tmp = pow(abs(num1/x[0]),2.0/x[4]) + pow(abs(num2/x[1]),2.0/x[4]);
+    return SuperqKernel::cost(x, points_soa);
+}
 
-     return pow( abs(tmp),x[4]/x[3]) + pow( abs(num3/x[2]),(2.0/x[3]));
+/****************************************************************/
+double SuperqEstimator::F_grad(const Vector11d &x, Vector11d &grad)
+{
+    return SuperqKernel::costGradient(x, points_soa, grad);
 }
 
 /****************************************************************/
-double SuperqEstimator::F_v(const Vector11d &x)
+bool SuperqEstimator::eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Number *grad_f)
 {
-     // Evaluate cost function for finite difference gradient computation
-     double value=0.0;
+    // Gradient is computed analytically together with the cost function
+    F(x, new_x);
 
-     for(auto point : points_downsampled.points)
-     {
-          double tmp = pow(f_v(x,point),x(3)) - 1;
-          value += tmp*tmp;
-     }
+    for (Ipopt::Index j = 0; j < n; j++)
+        grad_f[j] = aux_grad(j);
 
-     value *= x(0)*x(1)*x(2)/used_points;
+    return true;
+}
 
-     return value;
+/****************************************************************/
+double SuperqEstimator::F_hess(const Vector11d &x, Matrix11d &hess)
+{
+    return SuperqKernel::costHessian(x, points_soa, hess);
 }
 
 /****************************************************************/
-double SuperqEstimator::f_v(const Vector11d &x, const Vector3d &point_cloud)
+bool SuperqEstimator::eval_h(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                             Ipopt::Number obj_factor, Ipopt::Index m, const Ipopt::Number *lambda,
+                             bool new_lambda, Ipopt::Index nele_hess, Ipopt::Index *iRow,
+                             Ipopt::Index *jCol, Ipopt::Number *values)
 {
-    Matrix3d R;
-    R = AngleAxisd(x(8), Vector3d::UnitZ())*
-      AngleAxisd(x(9), Vector3d::UnitY())*
-      AngleAxisd(x(10), Vector3d::UnitZ());
+    Ipopt::Index idx = 0;
+
+    if (values == NULL)
+    {
+        // Structure of the lower triangle
+        for (Ipopt::Index i = 0; i < n; i++)
+        {
+            for (Ipopt::Index j = 0; j <= i; j++)
+            {
+                iRow[idx] = i;
+                jCol[idx] = j;
+                idx++;
+            }
+        }
+    }
+    else
+    {
+        // No constraints, the hessian of the lagrangian is the one of the cost
+        Map<const Vector11d> x_tmp(x);
+
+        Matrix11d hess;
+        F_hess(x_tmp, hess);
 
-    double num1 = R(0,0)*point_cloud(0) + R(1,0)*point_cloud(1) + R(2,0)*point_cloud(2) - x(5)*R(0,0) - x(6)*R(1,0) - x(7)*R(2,0);
-    double num2 = R(0,1)*point_cloud(0) + R(1,1)*point_cloud(1) + R(2,1)*point_cloud(2) - x(5)*R(0,1) - x(6)*R(1,1) - x(7)*R(2,1);
-    double num3 = R(0,2)*point_cloud(0) + R(1,2)*point_cloud(1) + R(2,2)*point_cloud(2) - x(5)*R(0,2) - x(6)*R(1,2) - x(7)*R(2,2);
-    double tmp = pow(abs(num1/x(0)),2.0/x(4)) + pow(abs(num2/x(1)),2.0/x(4));
+        for (Ipopt::Index i = 0; i < n; i++)
+        {
+            for (Ipopt::Index j = 0; j <= i; j++)
+            {
+                values[idx] = obj_factor*hess(i,j);
+                idx++;
+            }
+        }
+    }
 
-    return pow( abs(tmp),x(4)/x(3)) + pow( abs(num3/x(2)),(2.0/x(3)));
+    return true;
 }
 
 /****************************************************************/
-bool SuperqEstimator::eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
-              Ipopt::Number *grad_f)
+double SuperqEstimator::checkHessian(const Vector11d &x, const double &eps)
 {
-    // Evaluate gradient with finite differences
-    Vector11d x_tmp(n);
-    double grad_p, grad_n;
-    double eps = 1e-8;
+    Matrix11d hess, hess_fd;
+    F_hess(x, hess);
 
-    for (Ipopt::Index j = 0; j < n; j++)
-        x_tmp(j) = x[j];
+    Vector11d x_tmp = x;
+    Vector11d grad_p, grad_n;
 
-    for (Ipopt::Index j = 0; j < n; j++)
+    for (int j = 0; j < 11; j++)
     {
-         x_tmp(j) += eps;
+        x_tmp(j) = x(j) + eps;
+        F_grad(x_tmp, grad_p);
+
+        x_tmp(j) = x(j) - eps;
+        F_grad(x_tmp, grad_n);
+
+        x_tmp(j) = x(j);
 
-         grad_p = F_v(x_tmp);
+        hess_fd.col(j) = (grad_p - grad_n)/(2.0*eps);
+    }
+
+    // Errors are relative to the largest entry of the hessian
+    double scale = max(hess_fd.lpNorm<Infinity>(), numeric_limits<double>::epsilon());
+
+    return (hess - hess_fd).lpNorm<Infinity>()/scale;
+}
 
-         x_tmp(j) -= eps;
+/****************************************************************/
+double SuperqEstimator::checkGradient(const Vector11d &x, const double &eps)
+{
+    Vector11d grad, grad_fd;
+    F_grad(x, grad);
 
-         grad_n = F_v(x_tmp);
+    Vector11d x_tmp = x;
+
+    for (int j = 0; j < 11; j++)
+    {
+        x_tmp(j) = x(j) + eps;
+        double grad_p = F_v(x_tmp);
 
-         grad_f[j] = (grad_p-grad_n)/eps;
+        x_tmp(j) = x(j) - eps;
+        double grad_n = F_v(x_tmp);
+
+        x_tmp(j) = x(j);
+
+        grad_fd(j) = (grad_p - grad_n)/(2.0*eps);
     }
 
-    return true;
+    // Errors are relative to the largest component of the gradient
+    double scale = max(grad_fd.lpNorm<Infinity>(), numeric_limits<double>::epsilon());
+
+    return (grad - grad_fd).lpNorm<Infinity>()/scale;
 }
 
  /****************************************************************/
@@ -325,11 +430,152 @@ void SuperqEstimator::finalize_solution(Ipopt::SolverReturn status, Ipopt::Index
                       Ipopt::IpoptCalculatedQuantities *ip_cq)
 {
     // Save solution in Superquadric class
-    Vector11d params_sol(n);
+    Vector11d params_sol = Map<const Vector11d>(x);
+
+    setSolution(params_sol);
+
+    // Bound multipliers are kept for warm starting the next estimation
     for (Ipopt::Index i = 0; i < n; i++)
-        params_sol[i] = x[i];
+    {
+        z_lower[i] = z_L[i];
+        z_upper[i] = z_U[i];
+    }
+}
+
+/****************************************************************/
+bool SuperqEstimator::intermediate_callback(Ipopt::AlgorithmMode mode, Ipopt::Index iter, Ipopt::Number obj_value,
+                                            Ipopt::Number inf_pr, Ipopt::Number inf_du, Ipopt::Number mu,
+                                            Ipopt::Number d_norm, Ipopt::Number regularization_size,
+                                            Ipopt::Number alpha_du, Ipopt::Number alpha_pr, Ipopt::Index ls_trials,
+                                            const Ipopt::IpoptData *ip_data, Ipopt::IpoptCalculatedQuantities *ip_cq)
+{
+    // Returning false makes Ipopt stop with User_Requested_Stop
+    if (cancelled())
+        return false;
+
+    if (time_limited && chrono::steady_clock::now() > deadline)
+    {
+        time_expired = true;
+        return false;
+    }
+
+    return true;
+}
+
+/****************************************************************/
+void SuperqEstimator::setCancelFlag(const atomic<bool> *flag)
+{
+    cancel_flag = flag;
+}
+
+/****************************************************************/
+bool SuperqEstimator::cancelled() const
+{
+    return (cancel_flag != nullptr && cancel_flag->load());
+}
+
+/****************************************************************/
+void SuperqEstimator::setTimeLimit(const double &seconds)
+{
+    deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+    time_limited = true;
+    time_expired = false;
+}
+
+/****************************************************************/
+bool SuperqEstimator::timeExpired() const
+{
+    return time_expired;
+}
+
+/****************************************************************/
+void SuperqEstimator::setWarmStart(const Vector11d &x_prev, const Vector11d &z_L, const Vector11d &z_U)
+{
+    // Bounds are tightened around the previous estimate, exponents stay
+    // within the ones of the object class
+    warm_bounds = bounds;
+
+    for (int i = 0; i < 3; i++)
+    {
+        warm_bounds(i,0) = 0.8*x_prev(i);
+        warm_bounds(i,1) = 1.25*x_prev(i);
+        warm_bounds(5+i,0) = x_prev(5+i) - 0.5*x_prev(i);
+        warm_bounds(5+i,1) = x_prev(5+i) + 0.5*x_prev(i);
+    }
+
+    for (int i = 3; i < 5; i++)
+    {
+        warm_bounds(i,0) = max(bounds(i,0), x_prev(i) - 0.2);
+        warm_bounds(i,1) = min(bounds(i,1), x_prev(i) + 0.2);
+    }
+
+    warm_bounds(8,0) = max(0.0, x_prev(8) - M_PI/6.0);
+    warm_bounds(8,1) = min(2*M_PI, x_prev(8) + M_PI/6.0);
+    warm_bounds(9,0) = max(0.0, x_prev(9) - M_PI/6.0);
+    warm_bounds(9,1) = min(M_PI, x_prev(9) + M_PI/6.0);
+    warm_bounds(10,0) = max(0.0, x_prev(10) - M_PI/6.0);
+    warm_bounds(10,1) = min(2*M_PI, x_prev(10) + M_PI/6.0);
+
+    x0 = x_prev.cwiseMax(warm_bounds.col(0)).cwiseMin(warm_bounds.col(1));
+    z_lower = z_L;
+    z_upper = z_U;
+    warm_start = true;
+}
+
+/****************************************************************/
+void SuperqEstimator::setInitialGuess(const Vector11d &x_init)
+{
+    // The bounds of the cold start, computed from x0, are kept as they are
+    computeBounds();
+    warm_bounds = bounds;
+
+    x0 = x_init.cwiseMax(warm_bounds.col(0)).cwiseMin(warm_bounds.col(1));
+    warm_start = true;
+}
 
-    solution.setSuperqParams(params_sol);
+/****************************************************************/
+void SuperqEstimator::getMultipliers(Vector11d &z_L, Vector11d &z_U) const
+{
+    z_L = z_lower;
+    z_U = z_upper;
+}
+
+/****************************************************************/
+double SuperqEstimator::cost(const Vector11d &x)
+{
+    return F_v(x);
+}
+
+/****************************************************************/
+void SuperqEstimator::getProblem(Vector11d &x_start, Matrix112d &x_bounds)
+{
+    computeBounds();
+
+    x_start = x0;
+    x_bounds = bounds;
+}
+
+/****************************************************************/
+double SuperqEstimator::residuals(const Vector11d &x, ArrayXd &rho, MatrixXd &J)
+{
+    // The cost a1*a2*a3/N * sum_i r_i^2 is written as sum_i rho_i^2,
+    // with rho_i = sqrt(a1*a2*a3/N) * r_i
+    SuperqKernel::residualJacobian(x, points_soa, rho, J);
+
+    double sqrt_K = sqrt(x(0)*x(1)*x(2)/used_points);
+
+    for (int j = 0; j < 3; j++)
+        J.col(j) = sqrt_K*J.col(j) + sqrt_K/(2.0*x(j))*rho.matrix();
+    J.rightCols(8) *= sqrt_K;
+    rho *= sqrt_K;
+
+    return rho.square().sum();
+}
+
+/****************************************************************/
+void SuperqEstimator::setSolution(const Vector11d &x)
+{
+    solution.setSuperqParams(x);
 }
 
 /****************************************************************/
@@ -347,10 +593,18 @@ SuperqEstimatorApp::SuperqEstimatorApp()
     pars.mu_strategy = "adaptive";
     pars.nlp_scaling_method = "gradient-based";
     pars.hessian_approximation = "limited-memory";
+    pars.derivative_test = "none";
     pars.print_level = 0;
     pars.object_class = "default";
     pars.optimizer_points = 50;
     pars.random_sampling = true;
+    pars.sampling_method = "random";
+    pars.solver = "ipopt";
+    pars.tracking_threshold = 10.0;
+    pars.warm_start = false;
+    pars.object_classes = {"default", "box", "cylinder", "sphere"};
+    pars.class_win_residual = 1e-4;
+    pars.n_threads = 0;
 
     m_pars.merge_model = true;
     m_pars.minimum_points = 150;
@@ -359,92 +613,451 @@ SuperqEstimatorApp::SuperqEstimatorApp()
     m_pars.threshold_section1 = 0.6;
     m_pars.threshold_section2 = 0.03;
     m_pars.debug = false;
+    m_pars.parallel_modeling = false;
+    m_pars.adaptive_splitting = false;
+    m_pars.split_residual = 0.05;
+    m_pars.parent_initial_guess = false;
+
+    superq_tree.reset(new SuperqTree);
+    superq_tree_new.reset(new SuperqTree);
+
+    last_iterations = 0;
+    tree_iterations = 0;
+    setup_time_saved = 0.0;
+    tracking_valid = false;
+    tracked_cost = 0.0;
+    cold_starts = 0;
+}
 
+/****************************************************************/
+vector<Superquadric> SuperqEstimatorApp::computeSuperq(const PointCloud &point_cloud)
+{
+    return estimateSuperq(point_cloud, false);
 }
+
 /****************************************************************/
-vector<Superquadric> SuperqEstimatorApp::computeSuperq(PointCloud &point_cloud)
+vector<Superquadric> SuperqEstimatorApp::computeSuperqAutoClass(const PointCloud &point_cloud, string &object_class)
 {
-    // Process for estimate the superquadric
-    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = new Ipopt::IpoptApplication;
-    app->Options()->SetNumericValue("tol",pars.tol);
-    app->Options()->SetIntegerValue("acceptable_iter",pars.acceptable_iter);
-    app->Options()->SetStringValue("mu_strategy",pars.mu_strategy);
-    app->Options()->SetIntegerValue("max_iter",pars.max_iter);
-    app->Options()->SetNumericValue("max_cpu_time",pars.max_cpu_time);
-    app->Options()->SetStringValue("nlp_scaling_method",pars.nlp_scaling_method);
-    app->Options()->SetStringValue("hessian_approximation",pars.hessian_approximation);
-    app->Options()->SetIntegerValue("print_level",pars.print_level);
-    //app->Options()->SetStringValue("derivative_test","first-order");
-    app->Initialize();
+    // Outcome of the estimation of one class
+    struct ClassFit
+    {
+        Ipopt::ApplicationReturnStatus status;
+        double residual;
+        double time;
+        int iterations;
+    };
+
+    const vector<string> &classes = pars.object_classes;
+    int n_classes = classes.size();
+
+    chrono::steady_clock::time_point tStart = chrono::steady_clock::now();
+
+    // All the classes select the same downsampled points, so that the residuals are
+    // comparable. The problems are set up here, only the solves run in the pool
+    cout << "|| ---------------------------------------------------- ||" << endl;
+
+    vector<Ipopt::SmartPtr<SuperqEstimator>> estims(n_classes);
+    // A winning class stops only the classes listed after it, so that the winner does not
+    // depend on which solves end first
+    unique_ptr<atomic<bool>[]> cancel(new atomic<bool>[max(n_classes, 1)]);
+
+    for (int i = 0; i < n_classes; i++)
+    {
+        estims[i] = new SuperqEstimator;
+        estims[i]->init();
+        estims[i]->configure(classes[i]);
+        estims[i]->setPoints(point_cloud, pars.optimizer_points, pars.sampling_method);
+        cancel[i] = false;
+        estims[i]->setCancelFlag(&cancel[i]);
+    }
+
+    cout << "|| Downsampled points used for modeling                 :  " << estims[0]->points_downsampled.getNumberPoints() << endl;
+    logSerialSolver();
+
+    IpoptParam solve_pars = pars;
+    solve_pars.warm_start = false;
+
+    vector<future<ClassFit>> results;
+    {
+        // Each task has its own solver, sessions are not shared among threads
+        ThreadPool pool(min(pars.n_threads > 0 ? pars.n_threads : ThreadPool::hardwareThreads(), max(n_classes, 1)));
+
+        for (int i = 0; i < n_classes; i++)
+        {
+            results.push_back(pool.submit([i, n_classes, &estims, &solve_pars, &cancel]()
+            {
+                const Ipopt::SmartPtr<SuperqEstimator> &estim = estims[i];
+
+                chrono::steady_clock::time_point tClass = chrono::steady_clock::now();
+
+                unique_ptr<SuperqSolver> class_solver(SuperqSolver::create(solve_pars.solver, true));
+
+                ClassFit fit;
+                fit.status = class_solver->solve(solve_pars, estim);
+                fit.iterations = class_solver->getIterations();
+                fit.time = chrono::duration<double>(chrono::steady_clock::now() - tClass).count();
+
+                // Residual independent of the superquadric size
+                Vector11d x = estim->get_result().getSuperqParams();
+                fit.residual = estim->cost(x)/max(x(0)*x(1)*x(2), numeric_limits<double>::epsilon());
+
+                if (fit.status == Ipopt::Solve_Succeeded && fit.residual <= solve_pars.class_win_residual)
+                {
+                    for (int j = i + 1; j < n_classes; j++)
+                        cancel[j] = true;
+                }
+
+                return fit;
+            }));
+        }
+    }
+
+    double computation_time = chrono::duration<double>(chrono::steady_clock::now() - tStart).count();
+    double serial_time = 0.0;
+
+    int best = -1;
+    int winner = -1;
+    vector<ClassFit> fits;
+    for (int i = 0; i < n_classes; i++)
+    {
+        fits.push_back(results[i].get());
+        serial_time += fits[i].time;
+
+        if (fits[i].status != Ipopt::Solve_Succeeded && fits[i].status != Ipopt::Maximum_CpuTime_Exceeded)
+            continue;
+
+        if (winner < 0 && fits[i].status == Ipopt::Solve_Succeeded && fits[i].residual <= pars.class_win_residual)
+            winner = i;
+
+        if (best < 0 || fits[i].residual < fits[best].residual)
+            best = i;
+    }
+
+    // The first winning class is never cancelled, the classes before it always run to the end
+    if (winner >= 0)
+        best = winner;
+
+    IOFormat CommaInitFmt(StreamPrecision, DontAlignCols,", ", ", ", "", "", " [ ", "]");
+
+    for (int i = 0; i < n_classes; i++)
+    {
+        ostringstream label;
+        label << "|| Class " << classes[i];
+        cout << left << setw(56) << label.str() << right << ":  ";
+        if (fits[i].status == Ipopt::User_Requested_Stop)
+            cout << "cancelled after " << fits[i].time << " [s]" << endl;
+        else if (fits[i].status == Ipopt::Solve_Succeeded || fits[i].status == Ipopt::Maximum_CpuTime_Exceeded)
+            cout << "residual " << fits[i].residual << " in " << fits[i].time << " [s], " << fits[i].iterations << " iterations" << endl;
+        else
+            cout << "no solution found" << endl;
+    }
+
+    Superquadric superq;
+    vector<Superquadric> superqs;
+
+    if (best >= 0)
+    {
+        superq = estims[best]->get_result();
+        object_class = classes[best];
+        last_iterations = fits[best].iterations;
+
+        cout << "|| Best object class                                    :  " << object_class << endl;
+        cout << "|| Superquadric estimated                               : ";
+        cout << superq.getSuperqParams().format(CommaInitFmt) << endl;
+    }
+    else
+    {
+        cerr << "|| Not solution found" << endl;
+        object_class = "";
+        Vector11d x;
+        x.setZero();
+        superq.setSuperqParams(x);
+    }
+
+    cout << "|| Computed in                                          :  ";
+    cout <<  computation_time << " [s], " << serial_time << " [s] if serial" << endl;
+    cout << "|| ---------------------------------------------------- ||" << endl << endl << endl;
+
+    superqs.push_back(superq);
+    return superqs;
+}
+
+/****************************************************************/
+vector<Superquadric> SuperqEstimatorApp::computeSuperqBatch(const vector<PointCloud> &point_clouds, const int &n_threads)
+{
+    // Outcome of the estimation of one point cloud
+    struct CloudFit
+    {
+        Ipopt::ApplicationReturnStatus status;
+        Superquadric superq;
+        double time;
+        int iterations;
+    };
+
+    int n_clouds = point_clouds.size();
+    int threads = (n_threads > 0 ? n_threads : (pars.n_threads > 0 ? pars.n_threads : ThreadPool::hardwareThreads()));
+
+    IpoptParam solve_pars = pars;
+    solve_pars.warm_start = false;
+
+    logSerialSolver();
+
+    chrono::steady_clock::time_point tStart = chrono::steady_clock::now();
+
+    vector<future<CloudFit>> results;
+    {
+        ThreadPool pool(min(threads, max(n_clouds, 1)));
+
+        for (int i = 0; i < n_clouds; i++)
+        {
+            results.push_back(pool.submit([i, &point_clouds, &solve_pars]()
+            {
+                chrono::steady_clock::time_point tCloud = chrono::steady_clock::now();
+
+                Ipopt::SmartPtr<SuperqEstimator> estim = new SuperqEstimator;
+                estim->init();
+                estim->configure(solve_pars.object_class);
+                estim->setPoints(point_clouds[i], solve_pars.optimizer_points, solve_pars.sampling_method);
+
+                unique_ptr<SuperqSolver> cloud_solver(SuperqSolver::create(solve_pars.solver, true));
+
+                CloudFit fit;
+                fit.status = cloud_solver->solve(solve_pars, estim);
+                fit.iterations = cloud_solver->getIterations();
+
+                if (fit.status == Ipopt::Solve_Succeeded || fit.status == Ipopt::Maximum_CpuTime_Exceeded)
+                    fit.superq = estim->get_result();
+                else
+                {
+                    Vector11d x;
+                    x.setZero();
+                    fit.superq.setSuperqParams(x);
+                }
+
+                fit.time = chrono::duration<double>(chrono::steady_clock::now() - tCloud).count();
+
+                return fit;
+            }));
+        }
+    }
+
+    double computation_time = chrono::duration<double>(chrono::steady_clock::now() - tStart).count();
+
+    vector<Superquadric> superqs;
+    batch_times.clear();
+
+    cout << "|| ---------------------------------------------------- ||" << endl;
 
+    for (int i = 0; i < n_clouds; i++)
+    {
+        CloudFit fit = results[i].get();
+        superqs.push_back(fit.superq);
+        batch_times.push_back(fit.time);
+
+        ostringstream label;
+        label << "|| Point cloud " << i;
+        cout << left << setw(56) << label.str() << right << ":  ";
+        if (fit.status == Ipopt::Solve_Succeeded || fit.status == Ipopt::Maximum_CpuTime_Exceeded)
+            cout << fit.time << " [s], " << fit.iterations << " iterations" << endl;
+        else
+            cout << "no solution found" << endl;
+    }
+
+    cout << "|| Batch estimated in                                   :  ";
+    cout <<  computation_time << " [s] with " << min(threads, max(n_clouds, 1)) << " threads" << endl;
+    cout << "|| Throughput                                           :  ";
+    cout <<  n_clouds/max(computation_time, numeric_limits<double>::epsilon()) << " [clouds/s]" << endl;
+    cout << "|| ---------------------------------------------------- ||" << endl << endl << endl;
+
+    return superqs;
+}
+
+/****************************************************************/
+const vector<double> &SuperqEstimatorApp::getBatchTimes() const
+{
+    return batch_times;
+}
+
+/****************************************************************/
+vector<Superquadric> SuperqEstimatorApp::trackSuperq(const PointCloud &point_cloud)
+{
+    return estimateSuperq(point_cloud, true);
+}
+
+/****************************************************************/
+void SuperqEstimatorApp::resetTracking()
+{
+    tracking_valid = false;
+}
+
+/****************************************************************/
+int SuperqEstimatorApp::getColdStarts() const
+{
+    return cold_starts;
+}
+
+/****************************************************************/
+void SuperqEstimatorApp::updateSolver()
+{
+    // The solver session is created only at the first call or if the solver is changed
+    if (!solver || solver_name != pars.solver)
+    {
+        if (solver)
+            setup_time_saved += solver->getSetupTimeSaved();
+
+        solver.reset(SuperqSolver::create(pars.solver));
+        solver_name = pars.solver;
+    }
+}
+
+/****************************************************************/
+Ipopt::SmartPtr<SuperqEstimator> SuperqEstimatorApp::setupProblem(const PointCloud &point_cloud, ostream &log) const
+{
     Ipopt::SmartPtr<SuperqEstimator> estim = new SuperqEstimator;
     estim->init();
     estim->configure(pars.object_class);
 
-    cout << "|| ---------------------------------------------------- ||" << endl;
-    estim->setPoints(point_cloud, pars.optimizer_points, pars.random_sampling);
+    log << "|| ---------------------------------------------------- ||" << endl;
+    estim->setPoints(point_cloud, pars.optimizer_points, pars.sampling_method);
+    log << "|| Downsampled points used for modeling                 :  " << estim->points_downsampled.getNumberPoints() << endl;
+
+    return estim;
+}
 
-    clock_t tStart = clock();
+/****************************************************************/
+Superquadric SuperqEstimatorApp::solveSuperq(const Ipopt::SmartPtr<SuperqEstimator> &estim, SuperqSolver &task_solver,
+                                             const IpoptParam &solve_pars, ostream &log,
+                                             Ipopt::ApplicationReturnStatus &status) const
+{
+    chrono::steady_clock::time_point tStart = chrono::steady_clock::now();
 
-    Ipopt::ApplicationReturnStatus status = app->OptimizeTNLP(GetRawPtr(estim));
+    status = task_solver.solve(solve_pars, estim);
 
-    double computation_time = (double)(clock() - tStart)/CLOCKS_PER_SEC;
+    double computation_time = chrono::duration<double>(chrono::steady_clock::now() - tStart).count();
 
     Superquadric superq;
-    vector<Superquadric> superqs;
 
     IOFormat CommaInitFmt(StreamPrecision, DontAlignCols,", ", ", ", "", "", " [ ", "]");
 
     if (status == Ipopt::Solve_Succeeded)
     {
         superq = estim->get_result();
-        cout << "|| Superquadric estimated                               : ";
-        cout << superq.getSuperqParams().format(CommaInitFmt) << endl;
-        cout << "|| Computed in                                          :  ";
-        cout <<  computation_time << " [s]" << endl;
-        cout << "|| ---------------------------------------------------- ||" << endl << endl << endl;
-        superqs.push_back(superq);
-        return superqs;
+        log << "|| Superquadric estimated                               : ";
+        log << superq.getSuperqParams().format(CommaInitFmt) << endl;
+        log << "|| Computed in                                          :  ";
+        log <<  computation_time << " [s]" << endl;
+        log << "|| Iterations                                           :  ";
+        log <<  task_solver.getIterations() << endl;
+        log << "|| ---------------------------------------------------- ||" << endl << endl << endl;
     }
     else if(status == Ipopt::Maximum_CpuTime_Exceeded)
     {
         superq = estim->get_result();
-        cout << "|| Time expired                                         :" << superq.getSuperqParams().format(CommaInitFmt) << endl;
-        cout << "|| Superquadric estimated in                            :  " <<   computation_time << " [s]" << endl;
-        cout << "|| ---------------------------------------------------- ||" << endl << endl << endl;
-        superqs.push_back(superq);
-        return superqs;
+        log << "|| Time expired                                         :" << superq.getSuperqParams().format(CommaInitFmt) << endl;
+        log << "|| Superquadric estimated in                            :  " <<   computation_time << " [s]" << endl;
+        log << "|| ---------------------------------------------------- ||" << endl << endl << endl;
     }
     else
     {
-        cerr << "|| Not solution found" << endl;
-        cout << "|| ---------------------------------------------------- ||" << endl << endl << endl;
+        log << "|| Not solution found" << endl;
+        log << "|| ---------------------------------------------------- ||" << endl << endl << endl;
         Vector11d x(11);
         x.setZero();
 
         superq.setSuperqParams(x);
-        superqs.push_back(superq);
-        return superqs;
     }
 
+    return superq;
+}
+
+/****************************************************************/
+vector<Superquadric> SuperqEstimatorApp::estimateSuperq(const PointCloud &point_cloud, const bool &tracking)
+{
+    // Process for estimate the superquadric
+    updateSolver();
+
+    Ipopt::SmartPtr<SuperqEstimator> estim = setupProblem(point_cloud, cout);
+
+    IpoptParam solve_pars = pars;
+    solve_pars.warm_start = false;
+
+    if (tracking && tracking_valid)
+    {
+        // The previous estimate is used only if it still explains the new points,
+        // otherwise the object changed or moved too much
+        double cost_prev = estim->cost(tracked_superq.getSuperqParams());
+
+        if (cost_prev <= pars.tracking_threshold*max(tracked_cost, numeric_limits<double>::epsilon()))
+        {
+            estim->setWarmStart(tracked_superq.getSuperqParams(), tracked_z_L, tracked_z_U);
+            solve_pars.warm_start = true;
+            cout << "|| Tracking                                             :  warm start" << endl;
+        }
+        else
+        {
+            cold_starts++;
+            cout << "|| Tracking                                             :  residual jump, cold start" << endl;
+        }
+    }
+
+    Ipopt::ApplicationReturnStatus status;
+    vector<Superquadric> superqs;
+    superqs.push_back(solveSuperq(estim, *solver, solve_pars, cout, status));
+
+    last_iterations = solver->getIterations();
+
+    if (tracking)
+    {
+        tracking_valid = (status == Ipopt::Solve_Succeeded || status == Ipopt::Maximum_CpuTime_Exceeded);
+
+        if (tracking_valid)
+        {
+            tracked_superq = estim->get_result();
+            tracked_cost = estim->cost(tracked_superq.getSuperqParams());
+            estim->getMultipliers(tracked_z_L, tracked_z_U);
+        }
+    }
+
+    return superqs;
 }
 
 /****************************************************************/
-vector<Superquadric> SuperqEstimatorApp::computeMultipleSuperq(PointCloud &point_cloud)
+int SuperqEstimatorApp::getLastIterations() const
 {
-    superq_tree = new SuperqTree;
-    superq_tree_new = new SuperqTree;
+    return last_iterations;
+}
 
-    point_cloud_split1 = new PointCloud;
-    point_cloud_split2 = new PointCloud;
+/****************************************************************/
+int SuperqEstimatorApp::getTreeIterations() const
+{
+    return tree_iterations;
+}
 
-    clock_t tStart = clock();
+/****************************************************************/
+double SuperqEstimatorApp::getSetupTimeSaved() const
+{
+    return setup_time_saved + (solver ? solver->getSetupTimeSaved() : 0.0);
+}
+
+/****************************************************************/
+vector<Superquadric> SuperqEstimatorApp::computeMultipleSuperq(const PointCloud &point_cloud)
+{
+    // The nodes and the point clouds of the previous estimation are released here
+    superq_tree->reset();
+    superq_tree_new->reset();
+    tree_iterations = 0;
+
+    // Wall time, the process cpu time would also count the concurrent fits
+    chrono::steady_clock::time_point tStart = chrono::steady_clock::now();
 
     iterativeModeling(point_cloud);
 
-    double computation_time1 = (double)(clock() - tStart) / CLOCKS_PER_SEC;
+    double computation_time1 = chrono::duration<double>(chrono::steady_clock::now() - tStart).count();
+
+    cout << "|| ---------------------------------------------------- ||" << endl;
+    cout << "|| Superquadrics fitted on the splits                   : " << superq_tree->getNumberNodes() - 1 << endl;
 
-    double computation_time2;
+    double computation_time2 = 0.0;
 
     cout << "|| ---------------------------------------------------- ||" << endl;
     cout << "|| Multiple superquadrics estimated in                  : ";
@@ -453,35 +1066,47 @@ vector<Superquadric> SuperqEstimatorApp::computeMultipleSuperq(PointCloud &point
 
     if (m_pars.merge_model)
     {
-        tStart = clock();
+        tStart = chrono::steady_clock::now();
 
         findImportantPlanes(superq_tree->root);
 
         generateFinalTree(superq_tree->root, superq_tree_new->root);
 
+        double refits_time = 0.0, refits_serial_time = 0.0;
+        if (m_pars.parallel_modeling)
+        {
+            chrono::steady_clock::time_point tRefits = chrono::steady_clock::now();
+            refits_serial_time = solveMergeRefits();
+            refits_time = chrono::duration<double>(chrono::steady_clock::now() - tRefits).count();
+        }
+
         superq_tree->root = superq_tree_new->root;
 
-        computation_time2 = (double)(clock() - tStart) / CLOCKS_PER_SEC;
+        computation_time2 = chrono::duration<double>(chrono::steady_clock::now() - tStart).count();
 
         cout << "|| ---------------------------------------------------- ||" << endl;
         cout << "|| Merged model estimated in                            : ";
         cout <<    computation_time2 << " [s]" << endl;
+        if (m_pars.parallel_modeling)
+        {
+            cout << "|| Time saved by concurrent re-fits                     : ";
+            cout <<    max(refits_serial_time - refits_time, 0.0) << " [s]" << endl;
+        }
         cout << "|| ---------------------------------------------------- ||" << endl << endl << endl;
     }
 
     cout << "|| ---------------------------------------------------- ||" << endl;
     cout << "|| Complete modeling process took                       : ";
     cout <<    computation_time1 + computation_time2 << " [s]" << endl;
+    cout << "|| Solver setup time saved by session reuse             : ";
+    cout <<    getSetupTimeSaved() << " [s]" << endl;
     cout << "|| ---------------------------------------------------- ||" << endl << endl << endl;
 
-    delete point_cloud_split1;
-    delete point_cloud_split2;
-
     return fillSolution(superq_tree->root);
 }
 
 /***********************************************************************/
-void SuperqEstimatorApp::iterativeModeling(PointCloud &point_cloud)
+void SuperqEstimatorApp::iterativeModeling(const PointCloud &point_cloud)
 {
     if(point_cloud.getNumberPoints()/2 < m_pars.minimum_points)
         m_pars.minimum_points = point_cloud.getNumberPoints()/2;
@@ -504,9 +1129,31 @@ void SuperqEstimatorApp::iterativeModeling(PointCloud &point_cloud)
     cout << "|| Number of points for each point cloud                : " << point_cloud.getNumberPoints()/m_pars.fraction_pc << " " << endl;
     cout << "|| ---------------------------------------------------- ||" << endl << endl << endl;
 
-    superq_tree->setPoints(point_cloud);
+    // The tree points are views of the input points, which are never modified:
+    // the range of the input is not owned by the tree also if the input is a
+    // split view, so the first split copies the indices in a new array
+    root_points = point_cloud;
+    root_points.vis_range_owned = false;
+    superq_tree->setPoints(root_points);
+
+    if (m_pars.parallel_modeling)
+    {
+        logSerialSolver();
+
+        // Sibling subtrees are independent, each worker uses its own solver
+        ThreadPool pool(pars.n_threads);
+        vector<shared_ptr<SuperqSolver>> solvers(pool.size());
+        mutex log_mutex;
+
+        pool.run([this, &pool, &solvers, &log_mutex]()
+        {
+            computeNestedSuperqTask(superq_tree->root, pool, solvers, log_mutex);
+        });
 
-    computeNestedSuperq(superq_tree->root);
+        pool.wait();
+    }
+    else
+        computeNestedSuperq(superq_tree->root);
 }
 
 /***********************************************************************/
@@ -514,84 +1161,185 @@ void SuperqEstimatorApp::computeNestedSuperq(node *newnode)
 {
     if ((newnode != NULL))
     {
-        vector<Superquadric> superqs1;
-        vector<Superquadric> superqs2;
+        if (splitNeeded(newnode))
+        {
+            updateSolver();
+            fitChildren(newnode, *solver, cout);
+        }
 
-        nodeContent node_c1;
-        nodeContent node_c2;
+        computeNestedSuperq(newnode->left);
+        computeNestedSuperq(newnode->right);
+    }
+}
 
-        if ((newnode->height <= h_tree))
+/***********************************************************************/
+void SuperqEstimatorApp::computeNestedSuperqTask(node *newnode, ThreadPool &pool,
+                                                 vector<shared_ptr<SuperqSolver>> &solvers, mutex &log_mutex)
+{
+    if ((newnode != NULL))
+    {
+        if (splitNeeded(newnode))
         {
-            splitPoints(newnode);
+            // Each worker accesses only its own solver
+            shared_ptr<SuperqSolver> &task_solver = solvers[pool.currentWorker()];
+            if (!task_solver)
+                task_solver.reset(SuperqSolver::create(pars.solver, true));
 
-            cout << endl << "|| ---------------------------------------------------- ||" << endl;
-            cout << "|| Right node with height                               :  " << newnode->height << endl;
-            superqs1 = computeSuperq(*point_cloud_split1);
-            cout << endl << "|| ---------------------------------------------------- ||" << endl;
-            cout << "|| Left node with height                                :  " << newnode->height << endl;
-            superqs2 = computeSuperq(*point_cloud_split2);;
+            // The output of a node is printed all at once
+            ostringstream log;
+            fitChildren(newnode, *task_solver, log);
 
-            node_c1.superq = superqs1[0];
-            node_c2.superq = superqs2[0];
-            node_c1.point_cloud = new PointCloud;
-            node_c2.point_cloud = new PointCloud;
+            lock_guard<mutex> lock(log_mutex);
+            cout << log.str();
+        }
 
-            *node_c1.point_cloud = *point_cloud_split1;
-            *node_c2.point_cloud = *point_cloud_split2;
+        node *left = newnode->left;
+        node *right = newnode->right;
 
-            node_c1.height = newnode->height + 1;
-            node_c2.height = newnode->height + 1;
+        if (left != NULL)
+            pool.run([this, left, &pool, &solvers, &log_mutex]() { computeNestedSuperqTask(left, pool, solvers, log_mutex); });
+        if (right != NULL)
+            pool.run([this, right, &pool, &solvers, &log_mutex]() { computeNestedSuperqTask(right, pool, solvers, log_mutex); });
+    }
+}
 
-            superq_tree->insert(node_c1, node_c2, newnode);
-        }
+/***********************************************************************/
+void SuperqEstimatorApp::fitChildren(node *newnode, SuperqSolver &task_solver, ostream &log)
+{
+    // The nodes keep the views of the points on their side of the plane
+    nodeContent node_c1;
+    nodeContent node_c2;
+    node_c1.point_cloud = superq_tree->newPointCloud();
+    node_c2.point_cloud = superq_tree->newPointCloud();
+    splitPoints(newnode, *node_c1.point_cloud, *node_c2.point_cloud, log);
 
-        computeNestedSuperq(newnode->left);
-        computeNestedSuperq(newnode->right);
-    }
+    double residual1, residual2;
+
+    log << endl << "|| ---------------------------------------------------- ||" << endl;
+    log << "|| Right node with height                               :  " << newnode->height << endl;
+    node_c1.superq = fitChild(*node_c1.point_cloud, newnode->superq, newnode->plane, true, task_solver, log, residual1);
+    log << endl << "|| ---------------------------------------------------- ||" << endl;
+    log << "|| Left node with height                                :  " << newnode->height << endl;
+    node_c2.superq = fitChild(*node_c2.point_cloud, newnode->superq, newnode->plane, false, task_solver, log, residual2);
+
+    node_c1.height = newnode->height + 1;
+    node_c2.height = newnode->height + 1;
+
+    superq_tree->insert(node_c1, node_c2, newnode);
+
+    // The residuals decide if the children are split with adaptive_splitting
+    newnode->right->residual = residual1;
+    newnode->left->residual = residual2;
 }
 
 /***********************************************************************/
-void SuperqEstimatorApp::splitPoints(node *leaf)
+Superquadric SuperqEstimatorApp::fitChild(const PointCloud &point_cloud, const Superquadric &parent, const Vector4d &plane,
+                                          const bool &positive_side, SuperqSolver &task_solver, ostream &log, double &residual)
 {
-    point_cloud_split1->deletePoints();
-    point_cloud_split2->deletePoints();
-    Vector3d center;
-    center.setZero();
+    IpoptParam solve_pars = pars;
+    solve_pars.warm_start = false;
+    Ipopt::ApplicationReturnStatus status;
 
-    for (auto point : leaf->point_cloud->points_for_vis)
+    Ipopt::SmartPtr<SuperqEstimator> estim = setupProblem(point_cloud, log);
+
+    Vector11d x_init;
+    if (m_pars.parent_initial_guess && childInitialGuess(parent, plane, positive_side, x_init))
     {
-        center(0) += point(0);
-        center(1) += point(1);
-        center(2) += point(2);
+        // The cut father is used only if it explains the points better than the cold start
+        Vector11d x_cold;
+        Matrix112d bounds;
+        estim->getProblem(x_cold, bounds);
+        x_init = x_init.cwiseMax(bounds.col(0)).cwiseMin(bounds.col(1));
+
+        if (estim->cost(x_init) < estim->cost(x_cold))
+            estim->setInitialGuess(x_init);
     }
 
-    center(0) /= leaf->point_cloud->points_for_vis.size();
-    center(1) /= leaf->point_cloud->points_for_vis.size();
-    center(2) /= leaf->point_cloud->points_for_vis.size();
+    Superquadric superq = solveSuperq(estim, task_solver, solve_pars, log, status);
+    tree_iterations += task_solver.getIterations();
+    residual = normalizedResidual(estim, superq, status);
+
+    return superq;
+}
+
+/***********************************************************************/
+bool SuperqEstimatorApp::childInitialGuess(const Superquadric &parent, const Vector4d &plane,
+                                           const bool &positive_side, Vector11d &x) const
+{
+    x = parent.getSuperqParams();
+    if (x(0) <= 0.0 || x(1) <= 0.0 || x(2) <= 0.0)
+        return false;
+
+    Matrix3d axes = parent.getSuperqAxes();
+    Vector3d normal = plane.head(3);
+    Vector3d center = x.segment(5,3);
+
+    int k;
+    (axes.transpose()*normal).cwiseAbs().maxCoeff(&k);
+    double cos_k = axes.col(k).dot(normal);
+
+    // Position of the plane along the axis, from the center. The child keeps at
+    // least a tenth of the father also if the plane does not cross it
+    double t = (plane(3) - normal.dot(center))/cos_k;
+    t = max(-0.8*x(k), min(0.8*x(k), t));
 
-    Matrix3d M;
-    M.setZero();
+    // End of the father along the axis on the side of the child
+    double end = ((cos_k > 0.0) == positive_side ? x(k) : -x(k));
 
-    for (auto point : leaf->point_cloud->points_for_vis)
+    x(k) = fabs(end - t)/2.0;
+    x.segment(5,3) = center + axes.col(k)*(end + t)/2.0;
+
+    return true;
+}
+
+/***********************************************************************/
+void SuperqEstimatorApp::logSerialSolver() const
+{
+    // The linear solver of Ipopt is not reentrant, see IpoptSession::optimizationMutex
+    if (pars.solver != "levenberg-marquardt")
     {
-        M(0,0) = M(0,0) + (point(1)-center(1))*(point(1)-center(1)) + (point(2)-center(2))*(point(2)-center(2));
-        M(0,1) = M(0,1) - (point(1)-center(1))*(point(0)-center(0));
-        M(0,2) = M(0,2) - (point(2)-center(2))*(point(0)-center(0));
-        M(1,1) = M(1,1) + (point(0)-center(0))*(point(0)-center(0)) + (point(2)-center(2))*(point(2)-center(2));
-        M(2,2) = M(2,2) + (point(1)-center(1))*(point(1)-center(1)) + (point(0)-center(0))*(point(0)-center(0));
-        M(1,2) = M(1,2) - (point(2)-center(2))*(point(1)-center(1));
+        cout << "|| Ipopt solves run one at a time, set solver to levenberg-marquardt" << endl;
+        cout << "|| for solving concurrently" << endl;
     }
+}
+
+/***********************************************************************/
+double SuperqEstimatorApp::normalizedResidual(const Ipopt::SmartPtr<SuperqEstimator> &estim, const Superquadric &superq,
+                                              const Ipopt::ApplicationReturnStatus &status) const
+{
+    if (status != Ipopt::Solve_Succeeded && status != Ipopt::Maximum_CpuTime_Exceeded)
+        return numeric_limits<double>::infinity();
+
+    Vector11d x = superq.getSuperqParams();
+    return estim->cost(x)/max(x(0)*x(1)*x(2), numeric_limits<double>::epsilon());
+}
+
+/***********************************************************************/
+bool SuperqEstimatorApp::splitNeeded(const node *leaf) const
+{
+    if (leaf->height > h_tree)
+        return false;
+
+    // The root has no superquadric of its own
+    if (!m_pars.adaptive_splitting || leaf->height == 1)
+        return true;
+
+    return (leaf->residual > m_pars.split_residual);
+}
+
+/***********************************************************************/
+void SuperqEstimatorApp::splitPoints(node *leaf, PointCloud &point_cloud1, PointCloud &point_cloud2, ostream &log)
+{
+    PointCloud &pc = *leaf->point_cloud;
 
-    M(0,0) = M(0,0)/leaf->point_cloud->points_for_vis.size();
-    M(0,1) = M(0,1)/leaf->point_cloud->points_for_vis.size();
-    M(0,2) = M(0,2)/leaf->point_cloud->points_for_vis.size();
-    M(1,1) = M(1,1)/leaf->point_cloud->points_for_vis.size();
-    M(2,2) = M(2,2)/leaf->point_cloud->points_for_vis.size();
-    M(1,2) = M(1,2)/leaf->point_cloud->points_for_vis.size();
+    // The statistics of the leaf were accumulated when its father was split,
+    // only the ones of the root require a pass on the points
+    PointCloudStats stats = pc.getStatsForVis();
+    Vector3d center = stats.getMean();
 
-    M(1,0) = M(0,1);
-    M(2,0) = M(0,2);
-    M(2,1) = M(1,2);
+    // Inertia matrix of the points
+    Matrix3d C = stats.getCovariance(center);
+    Matrix3d M = C.trace()*Matrix3d::Identity() - C;
 
     JacobiSVD<MatrixXd> svd(M, ComputeFullU | ComputeFullU);
     Matrix3d orientation = svd.matrixU();
@@ -602,74 +1350,53 @@ void SuperqEstimatorApp::splitPoints(node *leaf)
 
     leaf->plane = plane;
 
-    deque<Vector3d> deque_points1, deque_points2;
-
-    for (auto point : leaf->point_cloud->points_for_vis)
-    {
-        if (plane(0)*point(0)+plane(1)*point(1)+plane(2)*point(2) - plane(3) > 0)
-        {
-            deque_points1.push_back(point);
-          }
-        else
-        {
-            deque_points2.push_back(point);
-          }
-    }
-
-    point_cloud_split1->setPoints(deque_points1);
-    point_cloud_split2->setPoints(deque_points2);
-
-    cout << "|| ---------------------------------------------------- ||" << endl;
-    cout << "|| Number of points in point cloud right                :  " << point_cloud_split1->getNumberPoints() << endl;
-    cout << "|| Number of points in point cloud left                 :  " << point_cloud_split2->getNumberPoints() << endl;
-    cout << "|| ---------------------------------------------------- ||" << endl << endl << endl;
-}
+    // The leaf has been fitted already, its range of indices is partitioned
+    // in place between the two sides
+    pc.splitByPlane(plane, point_cloud1, point_cloud2, true);
 
-/****************************************************************/
-void SuperqEstimatorApp::computeSuperqAxis(node *node)
-{
-    node->axis_x = node->superq.getSuperqAxes().col(0);    //TEST ROW INSTEAD
-    node->axis_y = node->superq.getSuperqAxes().col(1);
-    node->axis_z = node->superq.getSuperqAxes().col(2);
+    log << "|| ---------------------------------------------------- ||" << endl;
+    log << "|| Number of points in point cloud right                :  " << point_cloud1.getNumberPoints() << endl;
+    log << "|| Number of points in point cloud left                 :  " << point_cloud2.getNumberPoints() << endl;
+    log << "|| ---------------------------------------------------- ||" << endl << endl << endl;
 }
 
 /****************************************************************/
 bool SuperqEstimatorApp::axisParallel(node *node1, node *node2, Matrix3d &relations)
 {
     double threshold = m_pars.threshold_axis;
-    if (abs(node1->axis_x.dot(node2->axis_x)) > threshold)
+    if (abs(node1->axis(0).dot(node2->axis(0))) > threshold)
     {
         relations(0,0) = 1;
     }
-    if  (abs(node1->axis_x.dot(node2->axis_y)) > threshold)
+    if  (abs(node1->axis(0).dot(node2->axis(1))) > threshold)
     {
         relations(0,1) = 1;
     }
-    if  (abs(node1->axis_x.dot(node2->axis_z)) > threshold)
+    if  (abs(node1->axis(0).dot(node2->axis(2))) > threshold)
     {
         relations(0,2) = 1;
     }
-    if (abs(node1->axis_y.dot(node2->axis_x)) > threshold)
+    if (abs(node1->axis(1).dot(node2->axis(0))) > threshold)
     {
         relations(1,0) = 1;
     }
-    if  (abs(node1->axis_y.dot(node2->axis_y)) > threshold)
+    if  (abs(node1->axis(1).dot(node2->axis(1))) > threshold)
     {
         relations(1,1) = 1;
     }
-    if  (abs(node1->axis_y.dot(node2->axis_z))> threshold)
+    if  (abs(node1->axis(1).dot(node2->axis(2)))> threshold)
     {
         relations(1,2) = 1;
     }
-    if (abs(node1->axis_z.dot(node2->axis_x)) > threshold)
+    if (abs(node1->axis(2).dot(node2->axis(0))) > threshold)
     {
         relations(2,0) = 1;
     }
-    if  (abs(node1->axis_z.dot(node2->axis_y)) > threshold)
+    if  (abs(node1->axis(2).dot(node2->axis(1))) > threshold)
     {
         relations(2,1) = 1;
     }
-    if  (abs(node1->axis_z.dot(node2->axis_z)) > threshold)
+    if  (abs(node1->axis(2).dot(node2->axis(2))) > threshold)
     {
         relations(2,2) = 1;
     }
@@ -678,17 +1405,17 @@ bool SuperqEstimatorApp::axisParallel(node *node1, node *node2, Matrix3d &relati
     {
         int i_max = 0;
         double max = -1.0;
-        if(abs(node1->axis_x.dot(node2->axis_x)) < abs(node1->axis_x.dot(node2->axis_y)))
+        if(abs(node1->axis(0).dot(node2->axis(0))) < abs(node1->axis(0).dot(node2->axis(1))))
         {
-            max = abs(node1->axis_x.dot(node2->axis_y));
+            max = abs(node1->axis(0).dot(node2->axis(1)));
             i_max = 1;
         }
         else
-            max = abs(node1->axis_x.dot(node2->axis_x));
+            max = abs(node1->axis(0).dot(node2->axis(0)));
 
-         if (max < abs(node1->axis_x.dot(node2->axis_z)))
+         if (max < abs(node1->axis(0).dot(node2->axis(2))))
          {
-            max = abs(node1->axis_x.dot(node2->axis_z));
+            max = abs(node1->axis(0).dot(node2->axis(2)));
             i_max = 2;
          }
 
@@ -700,17 +1427,17 @@ bool SuperqEstimatorApp::axisParallel(node *node1, node *node2, Matrix3d &relati
     {
         int i_max = 0;
         double max = -1.0;
-        if(abs(node1->axis_y.dot(node2->axis_x)) < abs(node1->axis_y.dot(node2->axis_y)))
+        if(abs(node1->axis(1).dot(node2->axis(0))) < abs(node1->axis(1).dot(node2->axis(1))))
         {
-            max = abs(node1->axis_y.dot(node2->axis_y));
+            max = abs(node1->axis(1).dot(node2->axis(1)));
             i_max = 1;
         }
         else
-            max = abs(node1->axis_y.dot(node2->axis_x));
+            max = abs(node1->axis(1).dot(node2->axis(0)));
 
-         if (max < abs(node1->axis_y.dot(node2->axis_z)))
+         if (max < abs(node1->axis(1).dot(node2->axis(2))))
          {
-            max = abs(node1->axis_y.dot(node2->axis_z));
+            max = abs(node1->axis(1).dot(node2->axis(2)));
             i_max = 2;
          }
 
@@ -722,17 +1449,17 @@ bool SuperqEstimatorApp::axisParallel(node *node1, node *node2, Matrix3d &relati
     {
         int i_max = 0;
         double max = -1.0;
-        if(abs(node1->axis_z.dot(node2->axis_x)) < abs(node1->axis_z.dot(node2->axis_y)))
+        if(abs(node1->axis(2).dot(node2->axis(0))) < abs(node1->axis(2).dot(node2->axis(1))))
         {
-            max = abs(node1->axis_z.dot(node2->axis_y));
+            max = abs(node1->axis(2).dot(node2->axis(1)));
             i_max = 1;
         }
         else
-            max = abs(node1->axis_z.dot(node2->axis_x));
+            max = abs(node1->axis(2).dot(node2->axis(0)));
 
-         if (max < abs(node1->axis_z.dot(node2->axis_z)))
+         if (max < abs(node1->axis(2).dot(node2->axis(2))))
          {
-            max = abs(node1->axis_z.dot(node2->axis_z));
+            max = abs(node1->axis(2).dot(node2->axis(2)));
             i_max = 2;
          }
 
@@ -758,16 +1485,16 @@ bool SuperqEstimatorApp::sectionEqual(node *node1, node *node2, Matrix3d &relati
     double threshold2 = m_pars.threshold_section2;
 
     Matrix3d R1;
-    R1.row(0) = node1->axis_x;
-    R1.row(1) = node1->axis_x;
-    R1.row(2) = node1->axis_x;
+    R1.row(0) = node1->axis(0);
+    R1.row(1) = node1->axis(0);
+    R1.row(2) = node1->axis(0);
 
     R1.transposeInPlace();
 
     Matrix3d R2;
-    R2.row(0) = node2->axis_x;
-    R2.row(1) = node2->axis_x;
-    R2.row(2) = node2->axis_x;
+    R2.row(0) = node2->axis(0);
+    R2.row(1) = node2->axis(0);
+    R2.row(2) = node2->axis(0);
 
     Matrix3d R2_rot;
     R2_rot = relations*R2;
@@ -881,22 +1608,22 @@ void SuperqEstimatorApp::computeEdges(node *node, deque<Vector3d> &edges)
 
     Vector3d point;
 
-    point = node->superq.getSuperqCenter() + node->superq.getSuperqDims()(0) * node->axis_x;
+    point = node->superq.getSuperqCenter() + node->superq.getSuperqDims()(0) * node->axis(0);
     edges.push_back(point);
 
-    point = node->superq.getSuperqCenter() - node->superq.getSuperqDims()(0) * node->axis_x;
+    point = node->superq.getSuperqCenter() - node->superq.getSuperqDims()(0) * node->axis(0);
     edges.push_back(point);
 
-    point = node->superq.getSuperqCenter() + node->superq.getSuperqDims()(1) * node->axis_y;
+    point = node->superq.getSuperqCenter() + node->superq.getSuperqDims()(1) * node->axis(1);
     edges.push_back(point);
 
-    point = node->superq.getSuperqCenter() - node->superq.getSuperqDims()(1) * node->axis_y;
+    point = node->superq.getSuperqCenter() - node->superq.getSuperqDims()(1) * node->axis(1);
     edges.push_back(point);
 
-    point = node->superq.getSuperqCenter() + node->superq.getSuperqDims()(2) * node->axis_z;
+    point = node->superq.getSuperqCenter() + node->superq.getSuperqDims()(2) * node->axis(2);
     edges.push_back(point);
 
-    point = node->superq.getSuperqCenter() - node->superq.getSuperqDims()(2) * node->axis_z;
+    point = node->superq.getSuperqCenter() - node->superq.getSuperqDims()(2) * node->axis(2);
     edges.push_back(point);
 }
 
@@ -909,9 +1636,6 @@ void SuperqEstimatorApp::copySuperqChildren(node *old_node, node *newnode)
     node_c1.superq = old_node->left->superq;
     node_c2.superq = old_node->right->superq;
 
-    node_c1.point_cloud = new PointCloud;
-    node_c2.point_cloud = new PointCloud;
-
     node_c1.point_cloud = old_node->left->point_cloud;
     node_c2.point_cloud = old_node->right->point_cloud;
 
@@ -921,6 +1645,8 @@ void SuperqEstimatorApp::copySuperqChildren(node *old_node, node *newnode)
     node_c1.plane_important = old_node->left->plane_important;
     node_c2.plane_important = old_node->right->plane_important;
 
+    discardMergeRefit(newnode);
+
     superq_tree_new->insert(node_c2, node_c1, newnode);
 }
 
@@ -929,7 +1655,11 @@ bool SuperqEstimatorApp::findImportantPlanes(node *current_node)
 {
     Matrix3d relations;
 
-    superq_tree->root->plane_important=false;
+    superq_tree->setPlaneImportant(superq_tree->root, false);
+
+    // The leaves of adaptive_splitting are not split, their planes are not considered
+    if (current_node->left == NULL || current_node->right == NULL)
+        return true;
     if (current_node->height < h_tree)
     {
         if (m_pars.debug)
@@ -958,8 +1688,6 @@ bool SuperqEstimatorApp::findImportantPlanes(node *current_node)
 
     if (current_node->height > 1 && current_node->plane_important == false)
     {
-        computeSuperqAxis(current_node->left);
-        computeSuperqAxis(current_node->right);
 
         if (m_pars.debug)
             cout << "|| Node height         " << current_node->height << endl;
@@ -969,25 +1697,21 @@ bool SuperqEstimatorApp::findImportantPlanes(node *current_node)
             if (m_pars.debug)
                 cout << "|| Superquadric to be merged!         " << endl;
 
-            current_node->plane_important = false;
+            superq_tree->setPlaneImportant(current_node, false);
 
             if (superq_tree->searchPlaneImportant(current_node->left) == false && superq_tree->searchPlaneImportant(current_node->right) == false)
-            {
-                current_node->left = NULL;
-                current_node->right = NULL;
-            }
+                superq_tree->removeChildren(current_node);
         }
         else
         {
             if (m_pars.debug)
                 cout << "|| Plane current node is important!       " << endl;
-            current_node->plane_important = true;
+            superq_tree->setPlaneImportant(current_node, true);
 
             node *node_uncle = ((current_node == current_node->father->right) ? current_node->father->left : current_node->father->right);
 
             if (node_uncle != NULL)
             {
-                computeSuperqAxis(node_uncle);
 
                 double distance_right = edgesClose(current_node->right, node_uncle);
                 double distance_left = edgesClose(current_node->left, node_uncle);
@@ -1017,13 +1741,13 @@ bool SuperqEstimatorApp::findImportantPlanes(node *current_node)
                 {
                     if (m_pars.debug)
                         cout << "|| Plane father is important      " << endl;
-                    current_node->father->plane_important = true;
+                    superq_tree->setPlaneImportant(current_node->father, true);
                 }
                 else
                 {
                     if (m_pars.debug)
                         cout << "|| Plane father is not important      " << endl;
-                    current_node->father->plane_important = false;
+                    superq_tree->setPlaneImportant(current_node->father, false);
                 }
             }
         }
@@ -1031,8 +1755,6 @@ bool SuperqEstimatorApp::findImportantPlanes(node *current_node)
 
     if (current_node->height == 1)
     {
-        computeSuperqAxis(current_node->left);
-        computeSuperqAxis(current_node->right);
 
         if (current_node->plane_important && m_pars.debug)
             cout << "|| Plane of root is important!     " << endl;
@@ -1041,12 +1763,12 @@ bool SuperqEstimatorApp::findImportantPlanes(node *current_node)
 
         if ( axisParallel(current_node->left, current_node->right, relations) && sectionEqual(current_node->left, current_node->right, relations) == false)
         {
-            current_node->plane_important = true;
+            superq_tree->setPlaneImportant(current_node, true);
         }
 
         if ((superq_tree->searchPlaneImportant(current_node->left) == false
                 && superq_tree->searchPlaneImportant(current_node->right) == false))
-            current_node->plane_important = true;
+            superq_tree->setPlaneImportant(current_node, true);
     }
 
     return true;
@@ -1171,45 +1893,125 @@ bool SuperqEstimatorApp::generateFinalTree(node *old_node, node *newnode)
 /****************************************************************/
 void SuperqEstimatorApp::superqUsingPlane(node *old_node, PointCloud *points, node *newnode)
 {
-    deque<Vector3d> deque_points1, deque_points2;
-    for (auto point : points->points_for_vis)
-    {
-        if (old_node->plane(0)*point(0) + old_node->plane(1)*point(1) + old_node->plane(2)*point(2) - old_node->plane(3) > 0)
-            deque_points1.push_back(point);
-        else
-            deque_points2.push_back(point);
-    }
-
-    point_cloud_split1->setPoints(deque_points1);
-    point_cloud_split2->setPoints(deque_points2);
-
-    vector<Superquadric> superqs1, superqs2;
-    superqs1 = computeSuperq(*point_cloud_split1);
-    superqs2 = computeSuperq(*point_cloud_split2);
-
+    // The points of the father are still viewed by the nodes of the first
+    // tree, the two sides share a new array of indices
     nodeContent node_c1;
     nodeContent node_c2;
-    node_c1.superq = superqs1[0];
-    node_c2.superq = superqs2[0];
-    node_c1.point_cloud = new PointCloud;
-    node_c2.point_cloud = new PointCloud;
+    node_c1.point_cloud = superq_tree_new->newPointCloud();
+    node_c2.point_cloud = superq_tree_new->newPointCloud();
 
-    *node_c1.point_cloud = *point_cloud_split1;
-    *node_c2.point_cloud = *point_cloud_split2;
+    points->splitByPlane(old_node->plane, *node_c1.point_cloud, *node_c2.point_cloud);
     node_c1.height = newnode->height + 1;
     node_c2.height = newnode->height + 1;
 
+    if (m_pars.parallel_modeling)
+    {
+        // The fits are solved later in solveMergeRefits, the nodes are created
+        // now since the rest of the merging only depends on the tree structure
+        Vector11d x;
+        x.setZero();
+        node_c1.superq.setSuperqParams(x);
+        node_c2.superq.setSuperqParams(x);
+
+        discardMergeRefit(newnode);
+
+        MergeRefit refit;
+        refit.right_points = node_c1.point_cloud;
+        refit.left_points = node_c2.point_cloud;
+        refit.old_node = old_node;
+        merge_refits[newnode] = refit;
+    }
+    else
+    {
+        // The father of old_node was fitted to the points being split
+        double residual;
+        updateSolver();
+        node_c1.superq = fitChild(*node_c1.point_cloud, old_node->father->superq, old_node->plane, true, *solver, cout, residual);
+        node_c2.superq = fitChild(*node_c2.point_cloud, old_node->father->superq, old_node->plane, false, *solver, cout, residual);
+    }
+
     superq_tree_new->insert(node_c1, node_c2, newnode);
 }
 
+/****************************************************************/
+void SuperqEstimatorApp::discardMergeRefit(node *newnode)
+{
+    // The children of newnode are being replaced, their pending fits are useless
+    map<node*, MergeRefit>::iterator it = merge_refits.find(newnode);
+
+    if (it != merge_refits.end())
+        merge_refits.erase(it);
+}
+
+/****************************************************************/
+double SuperqEstimatorApp::solveMergeRefits()
+{
+    // A fit of the points of a child of a node of the new tree
+    struct RefitTask
+    {
+        PointCloud *points;
+        node *child;
+        const node *old_node;
+        bool positive_side;
+    };
+
+    // Each fit writes only its own node, hence all of them run concurrently
+    vector<RefitTask> fits;
+    for (auto refit : merge_refits)
+    {
+        RefitTask right = {refit.second.right_points, refit.first->right, refit.second.old_node, true};
+        RefitTask left = {refit.second.left_points, refit.first->left, refit.second.old_node, false};
+        fits.push_back(right);
+        fits.push_back(left);
+    }
+
+    merge_refits.clear();
+
+    vector<double> times(fits.size(), 0.0);
+    {
+        ThreadPool pool(pars.n_threads);
+        vector<shared_ptr<SuperqSolver>> solvers(pool.size());
+        mutex log_mutex;
+
+        for (size_t i = 0; i < fits.size(); i++)
+        {
+            pool.run([this, i, &fits, &times, &pool, &solvers, &log_mutex]()
+            {
+                chrono::steady_clock::time_point tStart = chrono::steady_clock::now();
+
+                shared_ptr<SuperqSolver> &task_solver = solvers[pool.currentWorker()];
+                if (!task_solver)
+                    task_solver.reset(SuperqSolver::create(pars.solver, true));
+
+                ostringstream log;
+                double residual;
+                const RefitTask &fit = fits[i];
+                fit.child->superq = fitChild(*fit.points, fit.old_node->father->superq, fit.old_node->plane,
+                                             fit.positive_side, *task_solver, log, residual);
+
+                times[i] = chrono::duration<double>(chrono::steady_clock::now() - tStart).count();
+
+                lock_guard<mutex> lock(log_mutex);
+                cout << log.str();
+            });
+        }
+
+        pool.wait();
+    }
+
+    double serial_time = 0.0;
+    for (auto t : times)
+        serial_time += t;
+
+    return serial_time;
+}
+
 /****************************************************************/
 vector<Superquadric> SuperqEstimatorApp::fillSolution(node *leaf)
 {
     vector<Superquadric> superqs;
     addSuperqs(leaf, superqs);
 
-    delete superq_tree;
-
     return superqs;
 }
 
@@ -0,0 +1,179 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+
+/**
+ * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+ */
+
+#include <SuperquadricLibModel/threadPool.h>
+
+using namespace std;
+using namespace SuperqModel;
+
+namespace {
+
+// Pool and index of the worker running on the current thread
+thread_local const ThreadPool *current_pool = nullptr;
+thread_local int current_index = -1;
+
+}
+
+/*********************************************/
+ThreadPool::ThreadPool(const int &n_threads) : queued(0), unfinished(0), next_queue(0), stopping(false)
+{
+    int n = (n_threads > 0 ? n_threads : hardwareThreads());
+
+    for (int i = 0; i < n; i++)
+        queues.push_back(unique_ptr<WorkerQueue>(new WorkerQueue));
+
+    for (int i = 0; i < n; i++)
+        workers.push_back(thread(&ThreadPool::work, this, i));
+}
+
+/*********************************************/
+ThreadPool::~ThreadPool()
+{
+    wait();
+
+    {
+        lock_guard<mutex> lock(state_mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+
+    for (auto &w : workers)
+        w.join();
+}
+
+/*********************************************/
+void ThreadPool::run(const function<void()> &task)
+{
+    int index = currentWorker();
+
+    {
+        lock_guard<mutex> lock(state_mutex);
+        queued++;
+        unfinished++;
+
+        if (index < 0)
+            index = (next_queue++) % queues.size();
+    }
+
+    {
+        lock_guard<mutex> lock(queues[index]->tasks_mutex);
+        queues[index]->tasks.push_back(task);
+    }
+
+    work_cv.notify_one();
+}
+
+/*********************************************/
+bool ThreadPool::pop(const int &index, function<void()> &task)
+{
+    // Newest task of the own queue first
+    {
+        lock_guard<mutex> lock(queues[index]->tasks_mutex);
+        if (!queues[index]->tasks.empty())
+        {
+            task = move(queues[index]->tasks.back());
+            queues[index]->tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Then the oldest task of the other queues
+    for (size_t i = 1; i < queues.size(); i++)
+    {
+        WorkerQueue &victim = *queues[(index + i) % queues.size()];
+
+        lock_guard<mutex> lock(victim.tasks_mutex);
+        if (!victim.tasks.empty())
+        {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*********************************************/
+void ThreadPool::work(const int &index)
+{
+    current_pool = this;
+    current_index = index;
+
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(state_mutex);
+            work_cv.wait(lock, [this]() { return stopping || queued > 0; });
+
+            // Pending tasks are completed before stopping
+            if (queued == 0)
+                return;
+        }
+
+        // A task counted in queued may not be in its queue yet,
+        // in that case the search is repeated
+        function<void()> task;
+        if (!pop(index, task))
+            continue;
+
+        {
+            lock_guard<mutex> lock(state_mutex);
+            queued--;
+        }
+
+        task();
+
+        {
+            lock_guard<mutex> lock(state_mutex);
+            unfinished--;
+            if (unfinished == 0)
+                done_cv.notify_all();
+        }
+    }
+}
+
+/*********************************************/
+void ThreadPool::wait()
+{
+    unique_lock<mutex> lock(state_mutex);
+    done_cv.wait(lock, [this]() { return unfinished == 0; });
+}
+
+/*********************************************/
+int ThreadPool::size() const
+{
+    return (int)workers.size();
+}
+
+/*********************************************/
+int ThreadPool::currentWorker() const
+{
+    return (current_pool == this ? current_index : -1);
+}
+
+/*********************************************/
+int ThreadPool::hardwareThreads()
+{
+    unsigned int n = thread::hardware_concurrency();
+    return (n > 0 ? (int)n : 1);
+}
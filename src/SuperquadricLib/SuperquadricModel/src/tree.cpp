@@ -30,64 +30,81 @@ using namespace SuperqModel;
 /***********************************************************************/
 SuperqTree::SuperqTree()
 {
-    root = new node;
+    reset();
+}
+
+/***********************************************************************/
+node *SuperqTree::newNode()
+{
+    nodes.push_back(node());
+
+    node *leaf = &nodes.back();
     Vector11d init_par;
     init_par.setZero();
-    root->superq.setSuperqParams(init_par);
-    root->plane.setZero();
-    root->left = NULL;
-    root->right = NULL;
-    root->height = 1;
-    root->axis_x.setZero();
-    root->axis_y.setZero();
-    root->axis_z.setZero();
-    root->R.setIdentity();
-    root->plane_important = false;
-    root->uncle_close = NULL;
+    leaf->superq.setSuperqParams(init_par);
+    leaf->plane.setZero();
+    leaf->point_cloud = NULL;
+    leaf->left = NULL;
+    leaf->right = NULL;
+    leaf->father = NULL;
+    leaf->uncle_close = NULL;
+    leaf->residual = 0.0;
+    leaf->height = 1;
+    leaf->plane_important = false;
+    leaf->important_below = false;
+
+    return leaf;
+}
+
+/***********************************************************************/
+void SuperqTree::updateImportantBelow(node *leaf)
+{
+    for (node *current = leaf; current != NULL; current = current->father)
+    {
+        bool important_below = current->plane_important ||
+                               (current->left != NULL && current->left->important_below) ||
+                               (current->right != NULL && current->right->important_below);
+
+        // The ancestors were up to date with the previous value
+        if (important_below == current->important_below && current != leaf)
+            break;
+
+        current->important_below = important_below;
+    }
 }
 
 /***********************************************************************/
 void SuperqTree::reset()
 {
-    root = new node;
-    Vector11d init_par;
-    init_par.setZero();
-    root->superq.setSuperqParams(init_par);
-    root->plane.setZero();
-    root->left = NULL;
-    root->right = NULL;
-    root->height = 1;
-    root->axis_x.setZero();
-    root->axis_y.setZero();
-    root->axis_z.setZero();
-    root->R.setIdentity();
-    root->plane_important = false;
-    root->uncle_close = NULL;
+    lock_guard<std::mutex> lock(mutex);
+
+    // The nodes and the point clouds of the previous tree are released at once
+    nodes.clear();
+    point_clouds.clear();
+
+    root = newNode();
 }
 
 /***********************************************************************/
 SuperqTree::~SuperqTree()
 {
-    destroy_tree();
 }
 
 /***********************************************************************/
 void SuperqTree::destroy_tree()
 {
-    destroy_tree(root);
+    reset();
 }
 
 /***********************************************************************/
-void SuperqTree::destroy_tree(node *leaf)
+PointCloud *SuperqTree::newPointCloud()
 {
-    if (leaf != NULL)
-    {
-        destroy_tree(leaf->left);
-        destroy_tree(leaf->right);
-        delete leaf;
-    }
-}
+    lock_guard<std::mutex> lock(mutex);
 
+    point_clouds.push_back(PointCloud());
+
+    return &point_clouds.back();
+}
 
 /***********************************************************************/
 void SuperqTree::setPoints(SuperqModel::PointCloud &point_cloud)
@@ -104,8 +121,10 @@ void SuperqTree::insert_uncle(node *leaf,  node *uncle)
 /***********************************************************************/
 void SuperqTree::insert(const nodeContent &node_content1, const nodeContent &node_content2,  node *leaf)
 {
+    lock_guard<std::mutex> lock(mutex);
+
     if (leaf->right == NULL)
-        leaf->right = new node;
+        leaf->right = newNode();
 
     leaf->right->superq = node_content1.superq;
     leaf->right->plane = node_content1.plane;
@@ -114,11 +133,14 @@ void SuperqTree::insert(const nodeContent &node_content1, const nodeContent &nod
     leaf->right->left = NULL;
     leaf->right->right = NULL;
     leaf->right->father = leaf;
+    leaf->right->uncle_close = NULL;
+    leaf->right->residual = 0.0;
     leaf->right->height = node_content1.height;
     leaf->right->plane_important = false;
+    leaf->right->important_below = false;
 
     if (leaf->left == NULL)
-        leaf->left = new node;
+        leaf->left = newNode();
 
     leaf->left->superq = node_content2.superq;
     leaf->left->plane = node_content2.plane;
@@ -126,24 +148,48 @@ void SuperqTree::insert(const nodeContent &node_content1, const nodeContent &nod
     leaf->left->left = NULL;
     leaf->left->right = NULL;
     leaf->left->father = leaf;
+    leaf->left->uncle_close = NULL;
+    leaf->left->residual = 0.0;
     leaf->left->height = node_content2.height;
     leaf->left->plane_important = false;
+    leaf->left->important_below = false;
+
+    updateImportantBelow(leaf);
 }
 
 /***********************************************************************/
-bool SuperqTree::searchPlaneImportant(const node *leaf)
+void SuperqTree::setPlaneImportant(node *leaf, const bool &important)
 {
-    double one_false = false;
-    if (leaf != NULL)
-    {
-        searchPlaneImportant(leaf->left);
-        searchPlaneImportant(leaf->right);
+    lock_guard<std::mutex> lock(mutex);
 
-        if (leaf->plane_important == true)
-            one_false = one_false || leaf->plane_important;
-    }
+    leaf->plane_important = important;
+    updateImportantBelow(leaf);
+}
+
+/***********************************************************************/
+void SuperqTree::removeChildren(node *leaf)
+{
+    lock_guard<std::mutex> lock(mutex);
+
+    leaf->left = NULL;
+    leaf->right = NULL;
+    updateImportantBelow(leaf);
+}
+
+/***********************************************************************/
+bool SuperqTree::searchPlaneImportant(const node *leaf) const
+{
+    lock_guard<std::mutex> lock(mutex);
+
+    return (leaf != NULL && leaf->important_below);
+}
+
+/***********************************************************************/
+int SuperqTree::getNumberNodes() const
+{
+    lock_guard<std::mutex> lock(mutex);
 
-    return one_false;
+    return nodes.size();
 }
 
 /***********************************************************************/
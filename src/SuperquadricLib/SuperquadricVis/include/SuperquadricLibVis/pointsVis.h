@@ -25,6 +25,7 @@
 #define POINTSVTK_H
 
 #include <SuperquadricLibVis/vis.h>
+#include <SuperquadricLibModel/pointCloud.h>
 
 #include <vector>
 #include <Eigen/Dense>
@@ -52,6 +53,8 @@ protected:
     vtkSmartPointer<vtkUnsignedCharArray> vtk_colors;
     vtkSmartPointer<vtkPolyData> vtk_polydata;
     vtkSmartPointer<vtkVertexGlyphFilter> vtk_glyphFilter;
+    // Colors used by vtk_colors without copying them
+    SuperqModel::PointColors shared_colors;
 public:
     /**
     * Constructor
@@ -76,6 +79,13 @@ public:
      */
     bool set_colors(const std::vector<std::vector<unsigned char>> &colors);
 
+    /**
+     * Set the color of the points for visualization, without copying them
+     * @param colors are the packed colors of a point cloud, kept alive as long as they are shown
+     * @return true/false if the number of colors is the same as points
+     */
+    bool set_colors(const SuperqModel::PointColors &colors);
+
     vtkSmartPointer<vtkPolyData> &get_polydata();
 };
 
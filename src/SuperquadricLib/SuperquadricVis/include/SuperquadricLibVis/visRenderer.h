@@ -61,7 +61,6 @@ protected:
     // For visualizing point clouds
     std::unique_ptr<SuperqVis::PointsVis> vtk_all_points;
     std::unique_ptr<SuperqVis::PointsVis> vtk_dwn_points;
-    std::vector<std::vector<unsigned char>> all_colors;
     // For visualizing superquadrics
     std::vector<std::unique_ptr<SuperqVis::SuperquadricVis>> vtk_superquadrics;
     // For visualizing hand superquadrics
@@ -78,6 +78,24 @@ bool PointsVis::set_colors(const vector<vector<unsigned char>> &colors)
         return false;
 }
 
+/**********************************************/
+bool PointsVis::set_colors(const SuperqModel::PointColors &colors)
+{
+    if (colors.size() == vtk_points->GetNumberOfPoints() && !colors.empty())
+    {
+        // The array is not released by vtk, the colors keep it alive
+        shared_colors = colors;
+        vtk_colors = vtkSmartPointer<vtkUnsignedCharArray>::New();
+        vtk_colors->SetNumberOfComponents(3);
+        vtk_colors->SetArray(const_cast<unsigned char*>(shared_colors.data()), 3*shared_colors.size(), 1);
+
+        vtk_polydata->GetPointData()->SetScalars(vtk_colors);
+        return true;
+    }
+    else
+        return false;
+}
+
 /**********************************************/
 vtkSmartPointer<vtkPolyData> &PointsVis::get_polydata()
 {
@@ -140,18 +140,17 @@ void Visualizer::setSize(int w, int h)
 /**********************************************/
 void Visualizer::addPoints(PointCloud point_cloud, const bool &show_downsample)
 {
-    vector<Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> all_points = point_cloud.points_for_vis;
-    vector<vector<unsigned char>> all_colors = point_cloud.colors;
+    vector<Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> all_points = point_cloud.getPointsForVis();
 
     size_points = 4;
     mtx.lock();
     vtk_all_points->set_points(all_points);
-    vtk_all_points->set_colors(all_colors);
+    vtk_all_points->set_colors(point_cloud.colors);
 
     if (show_downsample)
     {
         size_points = 8;
-        vector<Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> dwn_points = point_cloud.points;
+        vector<Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> dwn_points = point_cloud.getPoints();
         vtk_dwn_points->set_points(dwn_points);
         vtk_dwn_points->get_actor()->GetProperty()->SetColor(1.0,0.0,0.0);
     }
@@ -171,7 +170,7 @@ void Visualizer::addPoints(PointCloud point_cloud, const bool &show_downsample)
 /**********************************************/
 void Visualizer::addPointsHands(PointCloud point_cloud)
 {
-    vector<Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> all_points = point_cloud.points_for_vis;
+    vector<Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> all_points = point_cloud.getPointsForVis();
 
     mtx.lock();
     vtk_hand_points->set_points(all_points);
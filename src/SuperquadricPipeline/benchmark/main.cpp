@@ -0,0 +1,405 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+/**
+ * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+ */
+
+#include <SuperquadricLibModel/superqKernel.h>
+#include <SuperquadricLibModel/superquadricEstimator.h>
+#include <SuperquadricLibModel/threadPool.h>
+
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace Eigen;
+using namespace SuperqModel;
+
+/*******************************************/
+void printUsage()
+{
+    cout << endl;
+    cout << "     Usage: Superquadric-Benchmark <mode> path/to/point_cloud_file [...]" << endl;
+    cout << "     Available modes: " << endl;
+    cout << "       hessian    compare exact and limited-memory hessian in single superquadric modeling" << endl;
+    cout << "       solver     compare ipopt and levenberg-marquardt in single superquadric modeling" << endl;
+    cout << "       tracking   compare cold and tracked estimation of a slowly moving object" << endl;
+    cout << "       batch      fit a batch of clouds with an increasing number of threads" << endl;
+    cout << "       sampling   compare the accuracy of the downsampling methods against the number of points" << endl;
+    cout << "       tree       compare cold and parent-initialized fits in multiple superquadric modeling" << endl << endl;
+}
+
+/*******************************************/
+int benchmarkStringOption(const vector<string> &files, const string &tag, const vector<string> &values, const int &runs)
+{
+    IOFormat CommaInitFmt(StreamPrecision, DontAlignCols,", ", ", ", "", "", " [ ", "]");
+
+    stringstream report;
+    report << setw(30) << left << "file" << setw(22) << tag << setw(14) << "iterations"
+           << setw(14) << "time [s]" << "superquadric" << endl;
+
+    for (auto file : files)
+    {
+        PointCloud point_cloud;
+        if (!point_cloud.readFromFile(file))
+            return EXIT_FAILURE;
+
+        for (auto value : values)
+        {
+            SuperqEstimatorApp estim;
+            estim.SetStringValue(tag, value);
+            // Same points in every run, so that only the solver differs
+            estim.SetBoolValue("random_sampling", false);
+
+            double time = 0.0;
+            int iterations = 0;
+            Superquadric superq;
+
+            for (int i = 0; i < runs; i++)
+            {
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                vector<Superquadric> superqs = estim.computeSuperq(point_cloud);
+                time += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+                iterations += estim.getLastIterations();
+                superq = superqs[0];
+            }
+
+            report << setw(30) << left << file.substr(file.find_last_of("/\\") + 1) << setw(22) << value
+                   << setw(14) << (double)iterations/runs << setw(14) << time/runs
+                   << superq.getSuperqParams().format(CommaInitFmt) << endl;
+        }
+    }
+
+    cout << endl << "|| ---------------------------------------------------- ||" << endl;
+    cout << "|| Average over " << runs << " runs" << endl;
+    cout << report.str();
+
+    return EXIT_SUCCESS;
+}
+
+/*******************************************/
+int benchmarkTracking(const vector<string> &files, const int &frames)
+{
+    vector<string> solvers;
+    solvers.push_back("ipopt");
+    solvers.push_back("levenberg-marquardt");
+
+    stringstream report;
+    report << setw(30) << left << "file" << setw(22) << "solver" << setw(22) << "iterations (cold)"
+           << setw(22) << "iterations (tracked)" << setw(14) << "cold starts" << endl;
+
+    for (auto file : files)
+    {
+        PointCloud point_cloud;
+        if (!point_cloud.readFromFile(file))
+            return EXIT_FAILURE;
+
+        for (auto solver : solvers)
+        {
+            SuperqEstimatorApp estim_cold, estim_track;
+            estim_cold.SetStringValue("solver", solver);
+            estim_track.SetStringValue("solver", solver);
+            estim_cold.SetBoolValue("random_sampling", false);
+            estim_track.SetBoolValue("random_sampling", false);
+
+            int iterations_cold = 0, iterations_track = 0;
+
+            for (int i = 0; i < frames; i++)
+            {
+                // The object slides by 2 mm and turns by 1 deg every frame
+                Matrix3d R;
+                R = AngleAxisd(i*M_PI/180.0, Vector3d::UnitZ());
+                Vector3d t(0.002*i, 0.0, 0.0);
+
+                deque<Vector3d> points;
+                for (auto point : point_cloud.getPoints())
+                    points.push_back(R*point + t);
+
+                PointCloud pc_cold, pc_track;
+                pc_cold.setPoints(points);
+                pc_track.setPoints(points);
+
+                estim_cold.computeSuperq(pc_cold);
+                estim_track.trackSuperq(pc_track);
+
+                // The first frame is a cold start for both
+                if (i > 0)
+                {
+                    iterations_cold += estim_cold.getLastIterations();
+                    iterations_track += estim_track.getLastIterations();
+                }
+            }
+
+            report << setw(30) << left << file.substr(file.find_last_of("/\\") + 1) << setw(22) << solver
+                   << setw(22) << (double)iterations_cold/(frames - 1) << setw(22) << (double)iterations_track/(frames - 1)
+                   << setw(14) << estim_track.getColdStarts() << endl;
+        }
+    }
+
+    cout << endl << "|| ---------------------------------------------------- ||" << endl;
+    cout << "|| Average over " << frames - 1 << " frames after the first one" << endl;
+    cout << report.str();
+
+    return EXIT_SUCCESS;
+}
+
+/*******************************************/
+int benchmarkBatch(const vector<string> &files, const int &batch_size)
+{
+    vector<PointCloud> point_clouds;
+
+    // The files are repeated, each time slightly moved, up to the batch size
+    for (int i = 0; (int)point_clouds.size() < batch_size; i++)
+    {
+        PointCloud point_cloud;
+        if (!point_cloud.readFromFile(files[i % files.size()]))
+            return EXIT_FAILURE;
+
+        Vector3d t(0.001*i, 0.0, 0.0);
+        deque<Vector3d> points;
+        for (auto point : point_cloud.getPoints())
+            points.push_back(point + t);
+
+        PointCloud pc;
+        pc.setPoints(points);
+        point_clouds.push_back(pc);
+    }
+
+    stringstream report;
+    report << setw(14) << left << "threads" << setw(14) << "time [s]" << setw(22) << "throughput [1/s]"
+           << setw(14) << "speedup" << "same results" << endl;
+
+    SuperqEstimatorApp estim;
+    vector<Superquadric> superqs_serial;
+    double time_serial = 0.0;
+
+    for (int threads = 1; threads <= ThreadPool::hardwareThreads(); threads *= 2)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        vector<Superquadric> superqs = estim.computeSuperqBatch(point_clouds, threads);
+        double time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        if (threads == 1)
+        {
+            superqs_serial = superqs;
+            time_serial = time;
+        }
+
+        bool same = true;
+        for (size_t i = 0; i < superqs.size(); i++)
+            same = same && (superqs[i].getSuperqParams() == superqs_serial[i].getSuperqParams());
+
+        report << setw(14) << left << threads << setw(14) << time << setw(22) << batch_size/time
+               << setw(14) << time_serial/time << (same ? "yes" : "no") << endl;
+    }
+
+    cout << endl << "|| ---------------------------------------------------- ||" << endl;
+    cout << "|| Batch of " << batch_size << " point clouds" << endl;
+    cout << report.str();
+
+    return EXIT_SUCCESS;
+}
+
+/*******************************************/
+double meanDistance(const PointCloud &point_cloud, const Superquadric &superq)
+{
+    // Approximated radial distance of all the points from the superquadric surface
+    Vector11d x = superq.getSuperqParams();
+    VectorXd pose(6);
+    pose << x.segment(5,3), x.segment(8,3);
+
+    deque<Vector3d> points;
+    for (int i = 0; i < point_cloud.getNumberPointsForVis(); i++)
+        points.push_back(point_cloud.getPointForVis(i));
+
+    PointsSoA points_soa;
+    points_soa.setPoints(points);
+    ArrayXd F;
+    superq.insideOutsideF(pose, points_soa, F);
+
+    double distance = 0.0;
+    for (size_t i = 0; i < points.size(); i++)
+        distance += (points[i] - x.segment(5,3)).norm()*fabs(1.0 - pow(F(i), -x(3)/2.0));
+
+    return distance/point_cloud.getNumberPointsForVis();
+}
+
+/*******************************************/
+int benchmarkSampling(const vector<string> &files, const vector<int> &points_num)
+{
+    vector<string> methods;
+    methods.push_back("stride");
+    methods.push_back("random");
+    methods.push_back("voxel");
+    methods.push_back("farthest");
+    methods.push_back("curvature");
+
+    stringstream report;
+    report << setw(30) << left << "file" << setw(14) << "method" << setw(10) << "points"
+           << setw(18) << "sampling [ms]" << setw(14) << "fit [s]" << "mean distance [mm]" << endl;
+
+    for (auto file : files)
+    {
+        PointCloud point_cloud;
+        if (!point_cloud.readFromFile(file))
+            return EXIT_FAILURE;
+
+        string name = file.substr(file.find_last_of("/\\") + 1);
+
+        // Reference fit with all the points
+        SuperqEstimatorApp estim_all;
+        estim_all.SetStringValue("solver", "levenberg-marquardt");
+        estim_all.SetIntegerValue("optimizer_points", point_cloud.getNumberPoints());
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        Superquadric superq_all = estim_all.computeSuperq(point_cloud)[0];
+        double time_all = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        report << setw(30) << left << name << setw(14) << "all" << setw(10) << point_cloud.getNumberPoints()
+               << setw(18) << 0.0 << setw(14) << time_all << 1000.0*meanDistance(point_cloud, superq_all) << endl;
+
+        for (auto method : methods)
+        {
+            for (auto n : points_num)
+            {
+                PointCloud pc = point_cloud;
+                start = chrono::steady_clock::now();
+                pc.subSample(n, method);
+                double time_sampling = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+                SuperqEstimatorApp estim;
+                estim.SetStringValue("solver", "levenberg-marquardt");
+                estim.SetStringValue("sampling_method", method);
+                estim.SetIntegerValue("optimizer_points", n);
+
+                start = chrono::steady_clock::now();
+                Superquadric superq = estim.computeSuperq(point_cloud)[0];
+                double time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+                report << setw(30) << left << name << setw(14) << method << setw(10) << n
+                       << setw(18) << 1000.0*time_sampling << setw(14) << time
+                       << 1000.0*meanDistance(point_cloud, superq) << endl;
+            }
+        }
+    }
+
+    cout << endl << "|| ---------------------------------------------------- ||" << endl;
+    cout << "|| Distance of all the points from the superquadric fitted on the downsampled ones" << endl;
+    cout << report.str();
+
+    return EXIT_SUCCESS;
+}
+
+/*******************************************/
+int benchmarkTree(const vector<string> &files)
+{
+    vector<string> solvers;
+    solvers.push_back("ipopt");
+    solvers.push_back("levenberg-marquardt");
+
+    stringstream report;
+    report << setw(30) << left << "file" << setw(22) << "solver" << setw(14) << "initial guess"
+           << setw(14) << "iterations" << setw(14) << "time [s]" << "superquadrics" << endl;
+
+    for (auto file : files)
+    {
+        PointCloud point_cloud;
+        if (!point_cloud.readFromFile(file))
+            return EXIT_FAILURE;
+
+        for (auto solver : solvers)
+        {
+            for (int parent = 0; parent < 2; parent++)
+            {
+                SuperqEstimatorApp estim;
+                estim.SetStringValue("solver", solver);
+                // Same points in every run, so that only the initial guess differs
+                estim.SetBoolValue("random_sampling", false);
+                estim.SetBoolValue("parent_initial_guess", parent == 1);
+
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                vector<Superquadric> superqs = estim.computeMultipleSuperq(point_cloud);
+                double time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+                report << setw(30) << left << file.substr(file.find_last_of("/\\") + 1) << setw(22) << solver
+                       << setw(14) << (parent == 1 ? "parent" : "cold") << setw(14) << estim.getTreeIterations()
+                       << setw(14) << time << superqs.size() << endl;
+            }
+        }
+    }
+
+    cout << endl << "|| ---------------------------------------------------- ||" << endl;
+    cout << "|| Solver iterations of all the fits of the tree, merge re-fits included" << endl;
+    cout << report.str();
+
+    return EXIT_SUCCESS;
+}
+
+/*******************************************/
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    string mode = argv[1];
+    vector<string> files(argv + 2, argv + argc);
+
+    if (mode == "hessian")
+    {
+        vector<string> values;
+        values.push_back("limited-memory");
+        values.push_back("exact");
+        return benchmarkStringOption(files, "hessian_approximation", values, 5);
+    }
+    else if (mode == "solver")
+    {
+        vector<string> values;
+        values.push_back("ipopt");
+        values.push_back("levenberg-marquardt");
+        return benchmarkStringOption(files, "solver", values, 5);
+    }
+    else if (mode == "tracking")
+        return benchmarkTracking(files, 20);
+    else if (mode == "batch")
+        return benchmarkBatch(files, 32);
+    else if (mode == "sampling")
+    {
+        vector<int> points_num;
+        points_num.push_back(10);
+        points_num.push_back(20);
+        points_num.push_back(30);
+        points_num.push_back(50);
+        return benchmarkSampling(files, points_num);
+    }
+    else if (mode == "tree")
+        return benchmarkTree(files);
+
+    printUsage();
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,99 @@
+/******************************************************************************
+* Copyright (C) 2019 Istituto Italiano di Tecnologia (IIT)
+*
+* This program is free software; you can redistribute it and/or modify it under
+* the terms of the GNU General Public License as published by the Free Software
+* Foundation; either version 2 of the License, or (at your option) any later
+* version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.                                                                     *
+ ******************************************************************************/
+/**
+ * @authors: Giulia Vezzani <giulia.vezzani@iit.it>
+ */
+
+#include <SuperquadricLibModel/pointCloud.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace SuperqModel;
+
+/*******************************************/
+void printUsage()
+{
+    cout << endl;
+    cout << "     Usage: Superquadric-Convert [--float] path/to/point_cloud_file [...]" << endl;
+    cout << "     Each point cloud file is converted to the binary format loaded by PointCloud::readFromFile" << endl;
+    cout << "     without parsing, and written next to it with the .sqpc extension." << endl;
+    cout << "     Options: " << endl;
+    cout << "       --float    store the coordinates in single precision" << endl << endl;
+}
+
+/*******************************************/
+int main(int argc, char* argv[])
+{
+    bool single_precision = false;
+    vector<string> files;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--float")
+            single_precision = true;
+        else
+            files.push_back(arg);
+    }
+
+    if (files.empty())
+    {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    int failures = 0;
+    for (auto &file : files)
+    {
+        PointCloud point_cloud;
+
+        chrono::steady_clock::time_point tStart = chrono::steady_clock::now();
+        if (!point_cloud.readFromFile(file))
+        {
+            failures++;
+            continue;
+        }
+        double read_time = chrono::duration<double>(chrono::steady_clock::now() - tStart).count();
+
+        string output = file + ".sqpc";
+        if (!point_cloud.writeToBinaryFile(output, single_precision))
+        {
+            failures++;
+            continue;
+        }
+
+        tStart = chrono::steady_clock::now();
+        PointCloud converted;
+        if (!converted.readFromFile(output) || converted.getNumberPoints() != point_cloud.getNumberPoints())
+        {
+            cerr << "Converted file \"" << output << "\" cannot be read back" << endl;
+            failures++;
+            continue;
+        }
+        double load_time = chrono::duration<double>(chrono::steady_clock::now() - tStart).count();
+
+        cout << file << " -> " << output << ": " << point_cloud.getNumberPoints() << " points, read in "
+             << read_time << " [s], binary loaded in " << load_time << " [s]" << endl;
+    }
+
+    return (failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -36,9 +36,8 @@
 #include <yarp/dev/CartesianControl.h>
 #include <yarp/dev/PolyDriver.h>
 
-#include <iCub/ctrl/clustering.h>
-
 #include <SuperquadricLibModel/superquadricEstimator.h>
+#include <SuperquadricLibModel/pointFilter.h>
 #include <SuperquadricLibVis/visRenderer.h>
 #include <SuperquadricLibGrasp/graspComputation.h>
 #include "src/SuperquadricPipelineDemo_IDL.h"
@@ -53,7 +52,6 @@ using namespace yarp::sig;
 using namespace yarp::dev;
 using namespace yarp::math;
 using namespace yarp::eigen;
-using namespace iCub::ctrl;
 
 /****************************************************************/
 enum class WhichHand
@@ -133,6 +131,8 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
 
     // Superquadric-lib objects
     SuperqModel::PointCloud point_cloud;
+    // Contiguous xyz coordinates viewed by point_cloud, valid until the next acquisition
+    vector<double> points_buffer;
     vector<Superquadric> superqs;
     GraspResults grasp_res_hand1, grasp_res_hand2;
     SuperqEstimatorApp estim;
@@ -193,8 +193,8 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
     /* class methods */
     bool requestPointCloud(const string &object, const Vector &position = Vector());
     bool acquireFromSFM();
-    void filterPC(vector<Vector> &pc, vector<vector<unsigned char>> &colors);
-    void removeOutliers(vector<Vector> &pc, vector<vector<unsigned char>> &all_colors);
+    void filterPC(vector<Vector> &pc, vector<unsigned char> &colors);
+    void removeOutliers();
     bool set_grasping_hand(const string &hand);
     void computeSuperqAndGrasp();
     bool isInClasses(const string &obj_name);
@@ -211,7 +211,7 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
 
     void setGraspContext(ICartesianControl *icart);
     Vector eigenToYarp(Eigen::VectorXd &v);
-    deque<Eigen::Vector3d> vectorYarptoEigen(vector<Vector> &yarp_points);
+    void vectorYarpToBuffer(vector<Vector> &yarp_points);
 
 };
 
@@ -1019,7 +1019,8 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
         vis.resetPoints();
 
         vector<Vector> points_yarp;
-        vector<vector<unsigned char>> all_colors;
+        // Packed rgb colors of the points
+        vector<unsigned char> all_colors;
 
         // open file
         ifstream fin(object_file);
@@ -1055,19 +1056,20 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
                 c[2] = 0;
             }
 
-            all_colors.push_back(c);
+            all_colors.insert(all_colors.end(), c.begin(), c.end());
         }
 
+        vectorYarpToBuffer(points_yarp);
+        bool loaded = point_cloud.setPoints(points_buffer.data(), points_yarp.size());
+        point_cloud.setColors(move(all_colors));
+
         // filtering
-        removeOutliers(points_yarp, all_colors);
+        if (loaded)
+            removeOutliers();
 
-        if(points_yarp.size() >= sq_model_params["minimum_points"])
+        if(loaded && point_cloud.getNumberPoints() >= sq_model_params["minimum_points"])
         {
-            yInfo() << "[from_off_file]: loaded point cloud with " << points_yarp.size() << " points";
-            deque<Eigen::Vector3d> points_eigen = vectorYarptoEigen(points_yarp);
-
-            point_cloud.setPoints(points_eigen);
-            point_cloud.setColors(all_colors);
+            yInfo() << "[from_off_file]: loaded point cloud with " << point_cloud.getNumberPoints() << " points";
 
             // Visualize acquired point cloud
             vis.addPoints(point_cloud, false);
@@ -1078,6 +1080,8 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
         }
         else
         {
+            // Rejected points are not kept, as before the filtering
+            point_cloud.deletePoints();
             yError() << prettyError( __FUNCTION__, "too few points in loaded point cloud");
             return false;
         }
@@ -1157,8 +1161,9 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
 
             for(int i=0; i<point_cloud.getNumberPoints(); ++i)
             {
-                cout << "p: "<< point_cloud.points[i][0] << point_cloud.points[i][1]<< point_cloud.points[i][2]<< endl;
-                fout << point_cloud.points[i][0] << point_cloud.points[i][1]<< point_cloud.points[i][2] << endl;
+                Eigen::Vector3d point = point_cloud.getPoint(i);
+                cout << "p: "<< point[0] << point[1]<< point[2]<< endl;
+                fout << point[0] << point[1]<< point[2] << endl;
             }
 
             fout.close();
@@ -1551,37 +1556,36 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
         bool success = yarp_pc.fromBottle(*pcBt);
 
         vector<Vector> acquired_points;
-        vector<vector<unsigned char>> acquired_colors;
+        // Packed rgb colors of the points
+        vector<unsigned char> acquired_colors;
+        acquired_colors.reserve(3*yarp_pc.size());
 
         Vector point(3);
-        vector<unsigned char> c;
-        c.resize(3);
 
         for (size_t i = 0; i < yarp_pc.size(); i++)
         {
             point(0)=yarp_pc(i).x; point(1)=yarp_pc(i).y; point(2)=yarp_pc(i).z;
-            c[0] = yarp_pc(i).r;
-            c[1] = yarp_pc(i).g;
-            c[2] = yarp_pc(i).b;
 
             acquired_points.push_back(point);
-            acquired_colors.push_back(c);
+            acquired_colors.push_back(yarp_pc(i).r);
+            acquired_colors.push_back(yarp_pc(i).g);
+            acquired_colors.push_back(yarp_pc(i).b);
         }
 
         cout << "|| ---------------------------------------------------- ||" << endl;
         cout << "|| received point cloud with n points                   : "<< acquired_points.size()<< endl;
         cout << "|| ---------------------------------------------------- ||" << endl<<endl;
 
-        // filtering
-        removeOutliers(acquired_points, acquired_colors);
+        vectorYarpToBuffer(acquired_points);
+        bool loaded = point_cloud.setPoints(points_buffer.data(), acquired_points.size());
+        point_cloud.setColors(move(acquired_colors));
 
-        deque<Eigen::Vector3d> eigen_points = vectorYarptoEigen(acquired_points);
+        // filtering
+        if (loaded)
+            removeOutliers();
 
-        if (success && (eigen_points.size() >= sq_model_params["minimum_points"]))
+        if (success && loaded && (point_cloud.getNumberPoints() >= sq_model_params["minimum_points"]))
         {
-            point_cloud.setPoints(eigen_points);
-            point_cloud.setColors(acquired_colors);
-
             // Visualize acquired point cloud
             vis.addPoints(point_cloud, false);
 
@@ -1589,7 +1593,10 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
             return true;
         }
         else
+        {
+            point_cloud.deletePoints();
             return false;
+        }
     }
 
     /****************************************************************/
@@ -1599,7 +1606,8 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
         vis.resetPoints();
 
         vector<Vector> acquired_points;
-        vector<vector<unsigned char>> acquired_colors;
+        // Packed rgb colors of the points
+        vector<unsigned char> acquired_colors;
 
         Bottle cmd_request;
         Bottle cmd_reply;
@@ -1669,14 +1677,10 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
             Bottle *point2D = pointsList.get(p_i).asList();
             PixelRgb point_rgb = inCamImg->pixel(point2D->get(0).asInt(), point2D->get(1).asInt());
 
-            vector<unsigned char> color(3);
-
-            color[0] = point_rgb.r;
-            color[1] = point_rgb.g;
-            color[2] = point_rgb.b;
-
             acquired_points.push_back(point);
-            acquired_colors.push_back(color);
+            acquired_colors.push_back(point_rgb.r);
+            acquired_colors.push_back(point_rgb.g);
+            acquired_colors.push_back(point_rgb.b);
         }
 
         cout << "|| ---------------------------------------------------- ||" << endl;
@@ -1685,25 +1689,30 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
 
         // filtering
         filterPC(acquired_points, acquired_colors);
-        removeOutliers(acquired_points, acquired_colors);
 
-        deque<Eigen::Vector3d> eigen_points = vectorYarptoEigen(acquired_points);
+        vectorYarpToBuffer(acquired_points);
+        bool loaded = point_cloud.setPoints(points_buffer.data(), acquired_points.size());
+        point_cloud.setColors(move(acquired_colors));
+
+        if (loaded)
+            removeOutliers();
 
-        if (eigen_points.size() >= sq_model_params["minimum_points"])
+        if (loaded && point_cloud.getNumberPoints() >= sq_model_params["minimum_points"])
         {
-            point_cloud.setPoints(eigen_points);
-            point_cloud.setColors(acquired_colors);
             // Visualize acquired point cloud
             vis.addPoints(point_cloud, false);
 
             return true;
         }
         else
+        {
+            point_cloud.deletePoints();
             return false;
+        }
     }
 
     /****************************************************************/
-    void SuperquadricPipelineDemo::filterPC(vector<Vector> &pc, vector<vector<unsigned char>> &colors)
+    void SuperquadricPipelineDemo::filterPC(vector<Vector> &pc, vector<unsigned char> &colors)
     {
         if(pc.empty())
         {
@@ -1714,7 +1723,7 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
         double x_max = pc[0][0];
 
         vector<Vector> new_pc;
-        vector<vector<unsigned char>> new_colors;
+        vector<unsigned char> new_colors;
 
         // get x max
         yInfo() << "filterPC: get max value on x...";
@@ -1733,13 +1742,7 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
             if (pc[i][0] > x_max - pc_filter_params["sfm_range"])
             {
                 new_pc.push_back(pc[i]);
-
-                vector<unsigned char> color(3);
-                color[0] = colors[i][0];
-                color[1] = colors[i][1];
-                color[2] = colors[i][2];
-
-                new_colors.push_back(color);
+                new_colors.insert(new_colors.end(), colors.begin() + 3*i, colors.begin() + 3*i + 3);
             }
         }
 
@@ -1747,67 +1750,26 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
         cout << "|| Points removed                                       : "<< pc.size() - new_pc.size() << endl;
         cout << "|| ---------------------------------------------------- ||" << endl<<endl;
 
-        pc.clear();
-        colors.clear();
-
-        pc = new_pc;
-        colors = new_colors;
+        pc.swap(new_pc);
+        colors.swap(new_colors);
     }
 
     /****************************************************************/
-    void SuperquadricPipelineDemo::removeOutliers(vector<Vector> &pc, vector<vector<unsigned char>> &all_colors)
+    void SuperquadricPipelineDemo::removeOutliers()
     {
-        if(pc.empty())
+        if(point_cloud.getNumberPoints() == 0)
         {
             yError() << prettyError(__FUNCTION__, "provided an empty point cloud");
             return;
         }
 
-        double t0=Time::now();
-
-        vector<Vector> in_points;
-        vector<vector<unsigned char>> in_colors;
-
-        Property options;
-        options.put("epsilon", pc_filter_params["radius_dbscan"]);
-        options.put("minpts", int(pc_filter_params["points_dbscan"]));
-
-        DBSCAN dbscan;
-        map<size_t,set<size_t>> clusters=dbscan.cluster(pc, options);
-
-        size_t largest_class; size_t largest_size=0;
-        for (auto it=begin(clusters); it!=end(clusters); it++)
-        {
-            if (it->second.size()>largest_size)
-            {
-                largest_size=it->second.size();
-                largest_class=it->first;
-            }
-        }
-
-        auto &c=clusters[largest_class];
-        for (size_t i=0; i<pc.size(); i++)
-        {
-            if (c.find(i)!=end(c))
-            {
-                in_points.push_back(pc[i]);
-                in_colors.push_back(all_colors[i]);
-            }
-        }
-
-        double t1=Time::now();
+        // Largest cluster, kept as a view of the points
+        DBSCANFilter dbscan(pc_filter_params["radius_dbscan"], int(pc_filter_params["points_dbscan"]));
+        int removed = dbscan.filter(point_cloud);
 
         cout << "|| ---------------------------------------------------- ||" << endl;
-        cout << "|| Outliers removed                                      : "<< pc.size() - in_points.size() << endl;
+        cout << "|| Outliers removed                                      : "<< removed << endl;
         cout << "|| ---------------------------------------------------- ||" << endl<<endl;
-
-
-        pc.clear();
-        all_colors.clear();
-
-        pc = in_points;
-        all_colors = in_colors;
-
     }
 
     /************************************************************************/
@@ -2174,16 +2136,17 @@ class SuperquadricPipelineDemo : public RFModule, SuperquadricPipelineDemo_IDL
     }
 
     /****************************************************************/
-    deque<Eigen::Vector3d> SuperquadricPipelineDemo::vectorYarptoEigen(vector<Vector> &yarp_points)
+    void SuperquadricPipelineDemo::vectorYarpToBuffer(vector<Vector> &yarp_points)
     {
-        deque<Eigen::Vector3d> eigen_points;
+        // point_cloud is a view of the buffer, so it has to be emptied before
+        points_buffer.resize(3*yarp_points.size());
 
         for (size_t i = 0; i < yarp_points.size(); i++)
         {
-            eigen_points.push_back(toEigen(yarp_points[i]));
+            points_buffer[3*i] = yarp_points[i][0];
+            points_buffer[3*i+1] = yarp_points[i][1];
+            points_buffer[3*i+2] = yarp_points[i][2];
         }
-
-        return eigen_points;
     }
 
     /****************************************************************/
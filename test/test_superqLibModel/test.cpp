@@ -1,11 +1,18 @@
 #include <SuperquadricLibModel/superquadric.h>
 #include <SuperquadricLibModel/pointCloud.h>
+#include <SuperquadricLibModel/pointFilter.h>
+#include <SuperquadricLibModel/spatialIndex.h>
+#include <SuperquadricLibModel/superquadricEstimator.h>
 #include <SuperquadricLibGrasp/graspPoses.h>
 
+#include <algorithm>
 #include <cstdlib>
 #include <cmath>
+#include <fstream>
 #include <iostream>
 #include <deque>
+#include <memory>
+#include <thread>
 
 using namespace std;
 using namespace Eigen;
@@ -212,6 +219,510 @@ int main()
         return EXIT_FAILURE;
     }
 
+    deque<Vector3d> ellipsoid_points;
+    for (double theta = 0.1; theta < M_PI; theta += 0.3)
+    {
+        for (double phi = 0.0; phi < 2*M_PI; phi += 0.4)
+        {
+            point << 0.05*sin(theta)*cos(phi) + 0.1, 0.03*sin(theta)*sin(phi) - 0.2, 0.08*cos(theta) + 0.3;
+            ellipsoid_points.push_back(point);
+        }
+    }
+
+    PointCloud pc_ellipsoid;
+    pc_ellipsoid.setPoints(ellipsoid_points);
+
+    {
+        ofstream fout("test-points.txt");
+        fout << "0.1 -0.2 3e-1 10 20 30 255\n";
+        fout << "-1.5\t2 0.25\r\n";
+        fout << "0 0 0 7 7 7\n";
+        fout << "\n";
+        fout << "1 1 1 1 2 3\n";
+    }
+
+    PointCloud pc_file;
+    bool read = pc_file.readFromFile(string("test-points.txt"));
+    remove("test-points.txt");
+
+    auto color = [&pc_file](const int &i) { return vector<unsigned char>(pc_file.colors[i], pc_file.colors[i] + 3); };
+
+    if (!read || pc_file.getNumberPoints() != 3 || (pc_file.getPoint(0) - Vector3d(0.1, -0.2, 0.3)).norm() > 0.0 ||
+        (pc_file.getPoint(1) - Vector3d(-1.5, 2.0, 0.25)).norm() > 0.0 || color(0) != vector<unsigned char>({10, 20, 30}) ||
+        color(1) != vector<unsigned char>({50, 100, 0}) || color(2) != vector<unsigned char>({50, 100, 0}))
+    {
+        cerr << "[ERROR] point cloud not read correctly from file"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    PointCloud pc_binary;
+    read = pc_file.writeToBinaryFile("test-points.sqpc") && pc_binary.readFromFile(string("test-points.sqpc"));
+    remove("test-points.sqpc");
+
+    if (!read || pc_binary.getNumberPoints() != pc_file.getNumberPoints() || pc_binary.colors.size() != pc_file.colors.size() ||
+        !equal(pc_file.colors.data(), pc_file.colors.data() + 3*pc_file.colors.size(), pc_binary.colors.data()) ||
+        (pc_binary.getPoint(2) - pc_file.getPoint(2)).norm() > 0.0)
+    {
+        cerr << "[ERROR] point cloud not read correctly from binary file"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    for (string method : {"random", "reservoir", "voxel", "farthest", "curvature"})
+    {
+        PointCloud pc_sampled = pc_ellipsoid;
+        if (!pc_sampled.subSample(20, method) || pc_sampled.getNumberPoints() != 20 ||
+            pc_sampled.getNumberPointsForVis() != (int)ellipsoid_points.size())
+        {
+            cerr << "[ERROR] " << method << " sampling not correct"<<endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    PointCloudStats stats_upper, stats_lower;
+    for (auto &p : ellipsoid_points)
+    {
+        if (p(2) > 0.3)
+            stats_upper.add(p);
+        else
+            stats_lower.add(p);
+    }
+    stats_upper.merge(stats_lower);
+
+    PointCloudStats stats_all = pc_ellipsoid.getStats();
+    if (stats_upper.count != stats_all.count || (stats_upper.getBoundingBox() - stats_all.getBoundingBox()).norm() > 1e-12 ||
+        (stats_upper.getCovariance(stats_upper.getMean()) - stats_all.getCovariance(stats_all.getMean())).norm() > 1e-12)
+    {
+        cerr << "[ERROR] merged point cloud statistics not correct"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    PointCloud pc_above, pc_below, pc_right, pc_left;
+    pc_ellipsoid.splitByPlane(Vector4d(0.0, 0.0, 1.0, 0.3), pc_above, pc_below);
+    pc_above.splitByPlane(Vector4d(1.0, 0.0, 0.0, 0.1), pc_right, pc_left);
+
+    if (pc_above.getNumberPoints() + pc_below.getNumberPoints() != (int)ellipsoid_points.size() ||
+        pc_above.getNumberPoints() != stats_upper.count - stats_lower.count ||
+        pc_right.getNumberPoints() + pc_left.getNumberPoints() != pc_above.getNumberPoints() ||
+        pc_above.getPoint(pc_above.getNumberPoints() - 1)(2) <= 0.3 || pc_right.getPoint(0)(0) <= 0.1 || pc_right.getPoint(0)(2) <= 0.3 || pc_ellipsoid.getPoint(0) != ellipsoid_points[0])
+    {
+        cerr << "[ERROR] point cloud not split correctly"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    // Splitting a view does not reorder the points of the other views of its range
+    PointCloud pc_above_sampled = pc_above;
+    pc_above_sampled.subSample(50, false);
+    auto above_points = pc_above.getPointsForVis();
+    auto sampled_points = pc_above_sampled.getPoints();
+    shared_ptr<const KdTree> above_kd_tree = pc_above.getKdTree();
+    PointCloud pc_front, pc_back;
+    pc_above.splitByPlane(Vector4d(0.0, 1.0, 0.0, 0.0), pc_front, pc_back);
+
+    // Also the multiple superquadric estimation of a split view does not reorder it
+    SuperqEstimatorApp estim_view;
+    estim_view.SetStringValue("solver", "levenberg-marquardt");
+    estim_view.computeMultipleSuperq(pc_above);
+
+    if (pc_above.getPointsForVis() != above_points || pc_above_sampled.getPoints() != sampled_points || pc_above.getKdTree() != above_kd_tree ||
+        pc_front.getNumberPoints() + pc_back.getNumberPoints() != pc_above.getNumberPoints())
+    {
+        cerr << "[ERROR] point cloud views modified by split"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    shared_ptr<const KdTree> kd_tree = pc_ellipsoid.getKdTree();
+    shared_ptr<const VoxelHash> voxel_hash = pc_ellipsoid.getVoxelHash(0.02);
+    for (int q = 0; q < (int)ellipsoid_points.size(); q += 17)
+    {
+        Vector3d query = ellipsoid_points[q] + Vector3d(0.003, -0.002, 0.001);
+        vector<pair<double, int>> brute;
+        for (int i = 0; i < (int)ellipsoid_points.size(); i++)
+            brute.push_back(make_pair((ellipsoid_points[i] - query).squaredNorm(), i));
+        sort(brute.begin(), brute.end());
+
+        vector<int> knn, in_kd, in_voxel, in_brute;
+        vector<double> sq_distances;
+        kd_tree->knnSearch(query, 5, knn, sq_distances);
+        kd_tree->radiusSearch(query, 0.03, in_kd);
+        voxel_hash->radiusSearch(query, 0.03, in_voxel);
+        for (auto &b : brute)
+            if (b.first <= 0.03*0.03)
+                in_brute.push_back(b.second);
+
+        sort(in_kd.begin(), in_kd.end());
+        sort(in_voxel.begin(), in_voxel.end());
+        sort(in_brute.begin(), in_brute.end());
+
+        if (knn.size() != 5 || sq_distances[4] != brute[4].first || in_kd != in_brute || in_voxel != in_brute)
+        {
+            cerr << "[ERROR] spatial index queries not correct"<<endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    deque<Vector3d> noisy_points = ellipsoid_points;
+    noisy_points.push_back(Vector3d(0.5, 0.5, 0.5));
+    noisy_points.push_back(Vector3d(0.5, 0.5, 0.51));
+    noisy_points.push_back(Vector3d(-0.5, 0.0, 0.0));
+
+    for (int f = 0; f < 2; f++)
+    {
+        PointCloud pc_noisy;
+        pc_noisy.setPoints(noisy_points);
+        unique_ptr<PointFilter> outlier_filter(f == 0 ? (PointFilter*)new DBSCANFilter(0.04, 4) :
+                                                        (PointFilter*)new RadiusOutlierFilter(0.04, 2.0));
+
+        if (outlier_filter->filter(pc_noisy) != 3 || pc_noisy.getNumberPoints() != (int)ellipsoid_points.size() ||
+            (pc_noisy.getPoint(0) - ellipsoid_points[0]).norm() > 0.0)
+        {
+            cerr << "[ERROR] outliers not removed correctly"<<endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    Ipopt::SmartPtr<SuperqEstimator> estim = new SuperqEstimator;
+    estim->init();
+    estim->configure("default");
+    estim->setPoints(pc_ellipsoid, 50, false);
+
+    Vector11d x_test;
+    x_test << 0.06, 0.04, 0.07, 0.8, 1.2, 0.11, -0.19, 0.29, 0.3, 0.4, 0.5;
+
+    if (estim->checkGradient(x_test) > 1e-4)
+    {
+        cerr << "[ERROR] analytic gradient of superquadric cost not correct"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    if (estim->checkHessian(x_test) > 1e-4)
+    {
+        cerr << "[ERROR] exact hessian of superquadric cost not correct"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    SuperqEstimatorApp estim_lm;
+    estim_lm.SetStringValue("solver", "levenberg-marquardt");
+    estim_lm.SetBoolValue("random_sampling", false);
+
+    vector<Superquadric> superqs_lm = estim_lm.computeSuperq(pc_ellipsoid);
+    Vector3d dims_lm = superqs_lm[0].getSuperqDims();
+    sort(dims_lm.data(), dims_lm.data() + 3);
+
+    if ((dims_lm - Vector3d(0.03, 0.05, 0.08)).norm() > 5e-3 ||
+        (superqs_lm[0].getSuperqCenter() - Vector3d(0.1, -0.2, 0.3)).norm() > 5e-3)
+    {
+        cerr << "[ERROR] levenberg-marquardt superquadric estimation not correct"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    // Strided float buffer as in XYZRGBA sensor frames, used without copying
+    vector<float> frame(8*ellipsoid_points.size(), 0.0f);
+    for (size_t i = 0; i < ellipsoid_points.size(); i++)
+    {
+        frame[8*i] = (float)ellipsoid_points[i](0);
+        frame[8*i+1] = (float)ellipsoid_points[i](1);
+        frame[8*i+2] = (float)ellipsoid_points[i](2);
+    }
+
+    PointCloud pc_view;
+    pc_view.setPoints(frame.data(), ellipsoid_points.size(), 8*sizeof(float));
+
+    if (pc_view.getNumberPoints() != (int)ellipsoid_points.size() ||
+        (pc_view.getPoint(5) - ellipsoid_points[5]).norm() > 1e-6)
+    {
+        cerr << "[ERROR] point cloud view not set correctly"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<Superquadric> superqs_view = estim_lm.computeSuperq(pc_view);
+    Vector3d dims_view = superqs_view[0].getSuperqDims();
+    sort(dims_view.data(), dims_view.data() + 3);
+
+    if ((dims_view - Vector3d(0.03, 0.05, 0.08)).norm() > 5e-3 ||
+        (superqs_view[0].getSuperqCenter() - Vector3d(0.1, -0.2, 0.3)).norm() > 5e-3)
+    {
+        cerr << "[ERROR] superquadric estimation on point cloud view not correct"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    if (pc_view.getNumberPoints() != (int)ellipsoid_points.size() || pc_ellipsoid.getNumberPoints() != (int)ellipsoid_points.size())
+    {
+        cerr << "[ERROR] point clouds modified by the estimation"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    PointCloud pc_frame1 = pc_ellipsoid;
+    PointCloud pc_frame2 = pc_ellipsoid;
+    estim_lm.trackSuperq(pc_frame1);
+    int iterations_cold = estim_lm.getLastIterations();
+    estim_lm.trackSuperq(pc_frame2);
+
+    if (estim_lm.getLastIterations() >= iterations_cold || estim_lm.getColdStarts() > 0)
+    {
+        cerr << "[ERROR] tracking mode does not start from the previous superquadric"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    PointCloud pc_unknown;
+    pc_unknown.setPoints(ellipsoid_points);
+    string object_class;
+    vector<Superquadric> superqs_auto = estim_lm.computeSuperqAutoClass(pc_unknown, object_class);
+    Vector3d dims_auto = superqs_auto[0].getSuperqDims();
+    sort(dims_auto.data(), dims_auto.data() + 3);
+
+    if ((object_class != "default" && object_class != "sphere") ||
+        (dims_auto - Vector3d(0.03, 0.05, 0.08)).norm() > 5e-3 ||
+        pc_unknown.getNumberPoints() != (int)ellipsoid_points.size())
+    {
+        cerr << "[ERROR] superquadric estimation with unknown object class not correct"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<PointCloud> pc_batch;
+    for (int i = 0; i < 4; i++)
+    {
+        deque<Vector3d> points_moved;
+        for (auto point : ellipsoid_points)
+            points_moved.push_back(point + Vector3d(0.01*i, 0.0, 0.0));
+
+        PointCloud pc_moved;
+        pc_moved.setPoints(points_moved);
+        pc_batch.push_back(pc_moved);
+    }
+
+    vector<Superquadric> superqs_serial = estim_lm.computeSuperqBatch(pc_batch, 1);
+    vector<Superquadric> superqs_batch = estim_lm.computeSuperqBatch(pc_batch, 4);
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (superqs_batch[i].getSuperqParams() != superqs_serial[i].getSuperqParams() ||
+            (superqs_batch[i].getSuperqCenter() - Vector3d(0.1 + 0.01*i, -0.2, 0.3)).norm() > 5e-3)
+        {
+            cerr << "[ERROR] batch superquadric estimation not correct"<<endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    SuperqTree tree;
+    nodeContent content;
+    content.point_cloud = NULL;
+    content.plane.setZero();
+    tree.insert(content, content, tree.root);
+    tree.insert(content, content, tree.root->left);
+    tree.setPlaneImportant(tree.root->left->right, true);
+    bool important_set = tree.searchPlaneImportant(tree.root) && !tree.searchPlaneImportant(tree.root->right);
+    tree.setPlaneImportant(tree.root->left->right, false);
+
+    if (!important_set || tree.searchPlaneImportant(tree.root))
+    {
+        cerr << "[ERROR] important planes of the sub-trees not correct"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    // Subtrees grown by concurrent threads share the arenas and the flags of their ancestors
+    SuperqTree shared_tree;
+    vector<node *> subtree_roots(1, shared_tree.root);
+    while (subtree_roots.size() < 8)
+    {
+        vector<node *> leaves;
+        for (auto leaf : subtree_roots)
+        {
+            shared_tree.insert(content, content, leaf);
+            leaves.push_back(leaf->right);
+            leaves.push_back(leaf->left);
+        }
+        subtree_roots = leaves;
+    }
+
+    vector<thread> growers;
+    for (int t = 0; t < 8; t++)
+    {
+        growers.push_back(thread([&shared_tree, &subtree_roots, &content, t]()
+        {
+            vector<node *> leaves(1, subtree_roots[t]);
+            for (int level = 0; level < 8; level++)
+            {
+                vector<node *> children;
+                for (auto leaf : leaves)
+                {
+                    nodeContent child = content;
+                    child.point_cloud = shared_tree.newPointCloud();
+                    child.height = leaf->height + 1;
+                    shared_tree.insert(child, child, leaf);
+                    children.push_back(leaf->right);
+                    children.push_back(leaf->left);
+                }
+                leaves = children;
+            }
+            shared_tree.setPlaneImportant(leaves[t], true);
+        }));
+    }
+    for (auto &grower : growers)
+        grower.join();
+
+    bool shared_tree_correct = (shared_tree.getNumberNodes() == 15 + 8*510);
+    for (auto leaf : subtree_roots)
+        shared_tree_correct = shared_tree_correct && shared_tree.searchPlaneImportant(leaf);
+
+    if (!shared_tree_correct || !shared_tree.searchPlaneImportant(shared_tree.root))
+    {
+        cerr << "[ERROR] tree grown by concurrent threads not correct"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    // Two crossed bars, with enough points for the default three splitting levels
+    deque<Vector3d> cross_points;
+    for (double theta = 0.075; theta < M_PI; theta += 0.15)
+    {
+        for (double phi = 0.0; phi < 2*M_PI; phi += 0.15)
+        {
+            point << 0.12*sin(theta)*cos(phi), 0.02*sin(theta)*sin(phi), 0.02*cos(theta);
+            cross_points.push_back(point);
+            point << 0.02*sin(theta)*cos(phi), 0.12*sin(theta)*sin(phi), 0.02*cos(theta);
+            cross_points.push_back(point);
+        }
+    }
+
+    vector<vector<Superquadric>> superqs_multiple;
+    vector<int> nodes_multiple;
+    int iterations_unmerged = 0;
+    for (int parallel = 0; parallel < 2; parallel++)
+    {
+        PointCloud pc_cross;
+        pc_cross.setPoints(cross_points);
+
+        SuperqEstimatorApp estim_multiple;
+        estim_multiple.SetStringValue("solver", "levenberg-marquardt");
+        estim_multiple.SetBoolValue("merge_model", false);
+        estim_multiple.SetBoolValue("parallel_modeling", parallel == 1);
+        estim_multiple.SetIntegerValue("n_threads", 8);
+        superqs_multiple.push_back(estim_multiple.computeMultipleSuperq(pc_cross));
+        nodes_multiple.push_back(estim_multiple.superq_tree->getNumberNodes());
+        iterations_unmerged = estim_multiple.getTreeIterations();
+    }
+
+    // All the 14 nodes below the root of the three levels are fitted
+    bool same_multiple = (nodes_multiple[0] == 15 && nodes_multiple[1] == 15 && superqs_multiple[0].size() == 8 &&
+                          superqs_multiple[0].size() == superqs_multiple[1].size());
+    for (size_t i = 0; same_multiple && i < superqs_multiple[0].size(); i++)
+        same_multiple = (superqs_multiple[0][i].getSuperqParams() == superqs_multiple[1][i].getSuperqParams());
+
+    if (!same_multiple)
+    {
+        cerr << "[ERROR] parallel multiple superquadric estimation differs from the serial one"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    // Merging the cross re-fits the superquadrics of some important planes, concurrently if parallel
+    vector<vector<Superquadric>> superqs_merged;
+    vector<int> iterations_merged;
+    for (int parallel = 0; parallel < 2; parallel++)
+    {
+        PointCloud pc_cross;
+        pc_cross.setPoints(cross_points);
+
+        SuperqEstimatorApp estim_merged;
+        estim_merged.SetStringValue("solver", "levenberg-marquardt");
+        estim_merged.SetBoolValue("merge_model", true);
+        estim_merged.SetBoolValue("parallel_modeling", parallel == 1);
+        estim_merged.SetIntegerValue("n_threads", 8);
+        superqs_merged.push_back(estim_merged.computeMultipleSuperq(pc_cross));
+        iterations_merged.push_back(estim_merged.getTreeIterations());
+    }
+
+    bool same_merged = (iterations_merged[0] > iterations_unmerged && iterations_merged[0] == iterations_merged[1] &&
+                        !superqs_merged[0].empty() && superqs_merged[0].size() == superqs_merged[1].size());
+    for (size_t i = 0; same_merged && i < superqs_merged[0].size(); i++)
+        same_merged = (superqs_merged[0][i].getSuperqParams() == superqs_merged[1][i].getSuperqParams());
+
+    if (!same_merged)
+    {
+        cerr << "[ERROR] parallel merged multiple superquadric model differs from the serial one"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    // A bar with a post at one end: the half without the post is fitted well and
+    // is not split, the other half is
+    deque<Vector3d> bar_post_points;
+    for (double theta = 0.06; theta < M_PI; theta += 0.12)
+    {
+        for (double phi = 0.0; phi < 2*M_PI; phi += 0.12)
+        {
+            point << 0.12*sin(theta)*cos(phi), 0.02*sin(theta)*sin(phi), 0.02*cos(theta);
+            bar_post_points.push_back(point);
+            point << 0.02*sin(theta)*cos(phi) + 0.12, 0.02*sin(theta)*sin(phi), 0.08*cos(theta) + 0.08;
+            bar_post_points.push_back(point);
+        }
+    }
+
+    PointCloud pc_adaptive;
+    pc_adaptive.setPoints(bar_post_points);
+
+    SuperqEstimatorApp estim_adaptive;
+    estim_adaptive.SetStringValue("solver", "levenberg-marquardt");
+    estim_adaptive.SetBoolValue("merge_model", false);
+    estim_adaptive.SetBoolValue("parallel_modeling", true);
+    estim_adaptive.SetBoolValue("adaptive_splitting", true);
+    estim_adaptive.SetNumericValue("split_residual", 0.01);
+    vector<Superquadric> superqs_adaptive = estim_adaptive.computeMultipleSuperq(pc_adaptive);
+
+    node *adaptive_right = estim_adaptive.superq_tree->root->right;
+    node *adaptive_left = estim_adaptive.superq_tree->root->left;
+    bool right_split = (adaptive_right->left != NULL && adaptive_right->right != NULL);
+    bool left_split = (adaptive_left->left != NULL && adaptive_left->right != NULL);
+
+    if (superqs_adaptive.empty() || right_split == left_split || estim_adaptive.superq_tree->getNumberNodes() >= 15 ||
+        (int)superqs_adaptive.size() != (estim_adaptive.superq_tree->getNumberNodes() + 1)/2)
+    {
+        cerr << "[ERROR] adaptive multiple superquadric estimation not correct"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    // A plane orthogonal to the first axis of the father, 0.04 from its center, cuts
+    // the extents [0.04, 0.1] and [-0.1, 0.04] along the axis
+    Vector11d father_params;
+    father_params << 0.1, 0.02, 0.03, 0.5, 0.8, 0.1, -0.2, 0.3, 0.7, 0.0, 0.0;
+    Superquadric father;
+    father.setSuperqParams(father_params);
+    Vector3d father_axis = father.getSuperqAxes().col(0);
+    Vector4d cut_plane;
+    cut_plane << father_axis, father_axis.dot(father.getSuperqCenter()) + 0.04;
+
+    SuperqEstimatorApp estim_guess;
+    Vector11d guess_above, guess_below;
+    bool guess_valid = estim_guess.childInitialGuess(father, cut_plane, true, guess_above) &&
+                       estim_guess.childInitialGuess(father, cut_plane, false, guess_below);
+
+    if (!guess_valid || fabs(guess_above(0) - 0.03) > 1e-12 || fabs(guess_below(0) - 0.07) > 1e-12 ||
+        (guess_above.segment(5,3) - (father.getSuperqCenter() + 0.07*father_axis)).norm() > 1e-12 ||
+        (guess_below.segment(5,3) - (father.getSuperqCenter() - 0.03*father_axis)).norm() > 1e-12 ||
+        guess_above.segment(1,4) != father_params.segment(1,4) || guess_above.tail(3) != father_params.tail(3) ||
+        guess_below.segment(1,4) != father_params.segment(1,4))
+    {
+        cerr << "[ERROR] initial guess of the children not correct"<<endl;
+        return EXIT_FAILURE;
+    }
+
+    // The fits of the second and third levels of the cross start from their fathers
+    PointCloud pc_parent;
+    pc_parent.setPoints(cross_points);
+
+    SuperqEstimatorApp estim_parent;
+    estim_parent.SetStringValue("solver", "levenberg-marquardt");
+    estim_parent.SetBoolValue("merge_model", false);
+    estim_parent.SetBoolValue("parent_initial_guess", true);
+    vector<Superquadric> superqs_parent = estim_parent.computeMultipleSuperq(pc_parent);
+
+    bool parent_dims_valid = (superqs_parent.size() == 8);
+    for (size_t i = 0; parent_dims_valid && i < superqs_parent.size(); i++)
+        parent_dims_valid = (superqs_parent[i].getSuperqDims().minCoeff() > 0.0);
+
+    if (!parent_dims_valid || estim_parent.getTreeIterations() <= 0 || estim_parent.getTreeIterations() == iterations_unmerged)
+    {
+        cerr << "[ERROR] multiple superquadric estimation from the parent superquadrics not correct"<<endl;
+        return EXIT_FAILURE;
+    }
+
     if (!EXIT_SUCCESS)
         cout<<" == All tests passed! =="<<endl;
 